@@ -18,6 +18,7 @@
 #define RSTACK_SIZE    256
 #define DICT_SIZE      65536
 #define WORD_BUF_SIZE  64
+#define IO_BUF_SIZE    4096
 
 /* Stack */
 static long stack[STACK_SIZE];
@@ -43,6 +44,12 @@ static char word_buf[WORD_BUF_SIZE];
 /* Input handling */
 static int input_char = -2;  /* -2 = need to read, -1 = EOF */
 
+/* Block buffers for stdin/stdout */
+static unsigned char in_buf[IO_BUF_SIZE];
+static int in_pos = 0, in_len = 0;
+static char out_buf[IO_BUF_SIZE];
+static int out_len = 0;
+
 /* Dictionary entry structure (in dict array):
  *   link: 4 bytes (offset to previous entry, 0 = end)
  *   flags: 1 byte (bit 7 = immediate, bits 0-4 = length)
@@ -66,41 +73,70 @@ static void interpret(void);
 static int find_word(const char *name, int len);
 static int parse_number(const char *s, int len, long *result);
 
+/* Output buffering */
+static void write_all(const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(1, p, len);
+        if (n <= 0) return;
+        p += n;
+        len -= n;
+    }
+}
+
+static void out_flush(void) {
+    write_all(out_buf, out_len);
+    out_len = 0;
+}
+
+static void out_char(char c) {
+    if (out_len == IO_BUF_SIZE) out_flush();
+    out_buf[out_len++] = c;
+}
+
+/* Flush pending output, report and exit */
+static void fatal(const char *msg) {
+    out_flush();
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
 /* Check dictionary space */
 static void check_dict_space(int needed) {
-    if (here + needed >= DICT_SIZE) {
-        fprintf(stderr, "Dictionary overflow\n");
-        exit(1);
-    }
+    if (here + needed >= DICT_SIZE) fatal("Dictionary overflow");
 }
 
 /* Stack operations */
 static void push(long v) {
-    if (sp >= STACK_SIZE) { fprintf(stderr, "Stack overflow\n"); exit(1); }
+    if (sp >= STACK_SIZE) fatal("Stack overflow");
     stack[sp++] = v;
 }
 
 static long pop(void) {
-    if (sp <= 0) { fprintf(stderr, "Stack underflow\n"); exit(1); }
+    if (sp <= 0) fatal("Stack underflow");
     return stack[--sp];
 }
 
 static void rpush(long v) {
-    if (rsp >= RSTACK_SIZE) { fprintf(stderr, "Return stack overflow\n"); exit(1); }
+    if (rsp >= RSTACK_SIZE) fatal("Return stack overflow");
     rstack[rsp++] = v;
 }
 
 static long rpop(void) {
-    if (rsp <= 0) { fprintf(stderr, "Return stack underflow\n"); exit(1); }
+    if (rsp <= 0) fatal("Return stack underflow");
     return rstack[--rsp];
 }
 
-/* Input handling */
+/* Input handling; pending output is flushed before blocking on a refill */
 static int read_char(void) {
     if (input_char == -2) {
-        unsigned char c;
-        if (read(0, &c, 1) <= 0) return -1;
-        return c;
+        if (in_pos == in_len) {
+            out_flush();
+            ssize_t n = read(0, in_buf, sizeof(in_buf));
+            if (n <= 0) return -1;
+            in_pos = 0;
+            in_len = n;
+        }
+        return in_buf[in_pos++];
     }
     int c = input_char;
     input_char = -2;
@@ -191,8 +227,7 @@ static void prim_cstore(void) { char *p = (char*)pop(); *p = (char)pop(); }
 
 /* I/O */
 static void prim_emit(void) {
-    char c = (char)pop();
-    write(1, &c, 1);
+    out_char((char)pop());
 }
 
 static void prim_key(void) {
@@ -200,8 +235,9 @@ static void prim_key(void) {
     push(c == -1 ? 0 : c);
 }
 
-static void prim_cr(void) { write(1, "\n", 1); }
-static void prim_space(void) { write(1, " ", 1); }
+static void prim_cr(void) { out_char('\n'); }
+static void prim_space(void) { out_char(' '); }
+static void prim_flush(void) { out_flush(); }
 
 static void prim_dot(void) {
     char buf[24];
@@ -216,14 +252,19 @@ static void prim_dot(void) {
         n /= base;
     }
     if (neg) buf[i++] = '-';
-    while (i > 0) write(1, &buf[--i], 1);
-    write(1, " ", 1);
+    while (i > 0) out_char(buf[--i]);
+    out_char(' ');
 }
 
 static void prim_dots(void) {
-    printf("<%d> ", sp);
-    for (int i = 0; i < sp; i++) printf("%ld ", stack[i]);
-    printf("\n");
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "<%d> ", sp);
+    for (int i = 0; i < n; i++) out_char(buf[i]);
+    for (int i = 0; i < sp; i++) {
+        n = snprintf(buf, sizeof(buf), "%ld ", stack[i]);
+        for (int j = 0; j < n; j++) out_char(buf[j]);
+    }
+    out_char('\n');
 }
 
 /* Dictionary */
@@ -258,7 +299,7 @@ static void prim_align(void) {
 }
 
 /* Control */
-static void prim_bye(void) { exit(0); }
+static void prim_bye(void) { out_flush(); exit(0); }
 
 static void prim_execute(void) {
     primfn fn = (primfn)pop();
@@ -280,7 +321,7 @@ static void prim_tick(void) {
     int len = read_word(word_buf, WORD_BUF_SIZE);
     if (len == 0) { push(0); return; }
     int entry = find_word(word_buf, len);
-    if (entry == 0) { fprintf(stderr, "' unknown word\n"); push(0); return; }
+    if (entry == 0) { out_flush(); fprintf(stderr, "' unknown word\n"); push(0); return; }
     /* Get code pointer */
     int flags = dict[entry + 4];
     int nlen = flags & F_LENMASK;
@@ -399,6 +440,7 @@ static struct builtin builtins[] = {
     {"SPACE", prim_space, 0},
     {".", prim_dot, 0},
     {".S", prim_dots, 0},
+    {"FLUSH", prim_flush, 0},
 
     /* Dictionary */
     {"HERE", prim_here, 0},
@@ -547,6 +589,7 @@ static void interpret(void) {
         }
 
         /* Unknown word */
+        out_flush();
         fprintf(stderr, "%s ? unknown\n", word_buf);
     }
 }
@@ -567,6 +610,7 @@ int main(int argc, char **argv) {
     /* Main interpreter loop */
     for (;;) {
         if (isatty(0) && state == 0) {
+            out_flush();
             printf("> ");
             fflush(stdout);
         }
@@ -574,5 +618,6 @@ int main(int argc, char **argv) {
         if (!isatty(0)) break;  /* Exit on EOF in non-interactive mode */
     }
 
+    out_flush();
     return 0;
 }
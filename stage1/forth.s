@@ -49,9 +49,12 @@ got_data_buffer:
     //   +0x0008: var_HERE (8 bytes) - holds offset into data region
     //   +0x0010: var_BASE (8 bytes)
     //   +0x0018: var_LATEST (8 bytes) - holds offset from Lbase
-    //   +0x0020: input_buffer (256 bytes)
+    //   +0x0020: scratch (256 bytes) - free for programs (cc.fth cells)
     //   +0x0120: word_buffer (64 bytes)
-    //   +0x0160: return_stack (8192 bytes)
+    //   +0x0160: input_pos (8 bytes) - next byte in input_buffer
+    //   +0x0168: input_len (8 bytes) - bytes held in input_buffer
+    //   +0x0170: input_buffer (240 bytes)
+    //   +0x0260: return_stack (7936 bytes) - grows downward from 0x2160
     //   +0x2160: data_space (up to 0xE000)
     //   +0xE000: param_stack (8192 bytes) - grows downward
 
@@ -63,6 +66,10 @@ got_data_buffer:
     add     x0, x0, #8192
     str     x0, [x25, #8]
 
+    // Empty input buffer
+    str     xzr, [x25, #0x160]      // input_pos = 0
+    str     xzr, [x25, #0x168]      // input_len = 0
+
     // Initialize BASE = 10
     mov     x0, #10
     str     x0, [x25, #16]
@@ -106,9 +113,12 @@ got_data_buffer:
 .equ OFF_HERE,   8
 .equ OFF_BASE,   16
 .equ OFF_LATEST, 24
-.equ OFF_INPUT,  0x20
 .equ OFF_WORD,   0x120
-.equ OFF_RSTACK, 0x160
+.equ OFF_INPOS,  0x160
+.equ OFF_INLEN,  0x168
+.equ OFF_INPUT,  0x170
+.equ INPUT_SIZE, 0xF0
+.equ OFF_RSTACK, 0x260
 
 // NEXT: Offset-based threading
 next_trampoline:
@@ -431,18 +441,8 @@ name_KEY:
 code_KEY:
     .quad do_KEY - Lbase
 do_KEY:
-    mov     x0, #0
-    add     x1, x25, #OFF_WORD
-    mov     x2, #1
-    mov     x16, #SYS_read
-    svc     #0x80
-    cmp     x0, #1
-    b.eq    1f
-    mov     x0, #-1
-    b       2f
-1:
-    ldrb    w0, [x25, #OFF_WORD]
-2:
+    bl      read_char
+    sxtw    x0, w0
     str     x0, [x27, #-8]!
     NEXT
 
@@ -841,21 +841,32 @@ read_word:
     ldp     x29, x30, [sp], #16
     ret
 
+// Returns the next input byte in w0, or -1 at EOF. Refills
+// input_buffer with one read() of up to INPUT_SIZE bytes.
 read_char:
-    stp     x29, x30, [sp, #-16]!
-    sub     sp, sp, #16
+    ldr     x0, [x25, #OFF_INPOS]
+    ldr     x1, [x25, #OFF_INLEN]
+    cmp     x0, x1
+    b.lt    2f
     mov     x0, #0
-    mov     x1, sp
-    mov     x2, #1
+    add     x1, x25, #OFF_INPUT
+    mov     x2, #INPUT_SIZE
     mov     x16, #SYS_read
     svc     #0x80
+    b.cs    1f                  // carry set = error
     cmp     x0, #0
     b.le    1f
-    ldrb    w0, [sp]
-    b       2f
-1:  mov     w0, #-1
-2:  add     sp, sp, #16
-    ldp     x29, x30, [sp], #16
+    str     x0, [x25, #OFF_INLEN]
+    mov     x0, #0
+2:  add     x1, x25, #OFF_INPUT
+    ldrb    w1, [x1, x0]
+    add     x0, x0, #1
+    str     x0, [x25, #OFF_INPOS]
+    mov     w0, w1
+    ret
+1:  str     xzr, [x25, #OFF_INPOS]
+    str     xzr, [x25, #OFF_INLEN]
+    mov     w0, #-1
     ret
 
 find_word:
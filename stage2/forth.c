@@ -13,11 +13,22 @@
  */
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+#if defined(FORTH_PROFILE) && defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#if defined(FORTH_JIT) && (!defined(__x86_64__) || !defined(__linux__))
+#error "FORTH_JIT needs Linux on x86-64"
+#endif
 
 typedef intptr_t Cell;
 
@@ -28,24 +39,110 @@ enum {
     DICT_CELLS = 1 << 16,
     MAX_WORDS = 2048,
     STRING_HEAP_SIZE = 1 << 20,
+    IO_BUF_SIZE = 4096,
+    HASH_BUCKETS = 1024, /* power of two */
 };
 
 enum {
     F_IMMED = 0x80,
+    F_HIDDEN = 0x40,
+};
+
+/* How the inner interpreter runs a word; OP_PRIM calls word->code */
+enum {
+    OP_PRIM,
+    OP_COLON,
+    OP_EXIT,
+    OP_LIT,
+    OP_BRANCH,
+    OP_0BRANCH,
+    OP_EXECUTE,
+    OP_HALT,
+    /* Counted loops; limit and index live on the return stack */
+    OP_DO,
+    OP_QDO,
+    OP_LOOP,
+    OP_PLUS_LOOP,
+    OP_I,
+    OP_J,
+    OP_UNLOOP,
+    /* Words made by CONSTANT, VALUE, CREATE/VARIABLE and DOES> */
+    OP_CONSTANT,
+    OP_VALUE,
+    OP_CREATE,
+    OP_DOES,
+    OP_SET_DOES,
+    /* Superinstructions written over the first cell of a sequence */
+    OP_LIT_PLUS,
+    OP_LIT_MINUS,
+    OP_LIT_EQ,
+    OP_DUP_0BRANCH,
+    OP_0EQ_0BRANCH,
+    OP_OVER_OVER,
+    OP_SWAP_DROP,
+    /* FORTH_FAST only: run inline on the cached top of stack */
+    OP_DUP,
+    OP_DROP,
+    OP_SWAP,
+    OP_OVER,
+    OP_ROT,
+    OP_NIP,
+    OP_TUCK,
+    OP_QDUP,
+    OP_2DUP,
+    OP_2DROP,
+    OP_PLUS,
+    OP_MINUS,
+    OP_STAR,
+    OP_NEGATE,
+    OP_2STAR,
+    OP_2SLASH,
+    OP_MIN,
+    OP_MAX,
+    OP_LT,
+    OP_GT,
+    OP_EQ,
+    OP_0EQ,
 };
 
+#if defined(__GNUC__) && !defined(FORTH_SWITCH_DISPATCH)
+#define USE_COMPUTED_GOTO 1
+#endif
+
+/*
+ * FORTH_FAST keeps the top of stack in a local inside the inner loop and
+ * runs the common stack/arithmetic words without bounds checks. Depth is
+ * checked at calls, returns, branches, EXECUTE and C primitives instead,
+ * so an underflow made good again before the next check goes unnoticed.
+ * No straight run of thread cells can move the stack pointer more than
+ * two cells per cell, so a guard of 2 * DICT_CELLS on each side absorbs
+ * any excursion until the next check.
+ */
+#ifdef FORTH_FAST
+#define STACK_GUARD (2 * DICT_CELLS)
+#else
+#define STACK_GUARD 0
+#endif
+
 struct word;
 typedef void (*codefn)(void);
 
 struct word {
     struct word *link;
-    char *name;
+    struct word *hash_link; /* Older word in the same bucket */
+    char *name;             /* Upper-cased at definition time */
+    uint32_t hash;
+    uint8_t len;
     uint8_t flags;
+    uint8_t op;
     codefn code;
-    Cell *param; /* For colon definitions */
+    Cell *param; /* For colon definitions; data for CONSTANT etc. */
+    Cell *does;  /* Thread run with param pushed, for OP_DOES */
+    int here_mark, heap_mark; /* here and string_here before it was made */
 };
 
-static Cell stack[STACK_SIZE];
+static Cell stack_area[STACK_GUARD + STACK_SIZE + STACK_GUARD];
+static Cell *const stack = stack_area + STACK_GUARD;
 static int sp = 0;
 
 static Cell rstack[RSTACK_SIZE];
@@ -55,22 +152,87 @@ static struct word words[MAX_WORDS];
 static int num_words = 0;
 static struct word *latest = NULL;
 
+/* Newest definition first in each chain, so redefinitions shadow */
+static struct word *buckets[HASH_BUCKETS];
+
 static Cell dict[DICT_CELLS];
 static int here = 0; /* Index into dict (cells) */
 
-static Cell *ip = NULL; /* Inner interpreter instruction pointer */
 static int state = 0;   /* 0 = interpret, 1 = compile */
 static int base = 10;
 
 static struct word *w_lit;
 static struct word *w_exit;
+static struct word *w_branch;
+static struct word *w_0branch;
+static struct word *w_do, *w_qdo, *w_loop, *w_plus_loop, *w_unloop;
+static struct word *w_forget;
+static struct word *w_store, *w_set_does;
+static struct word *w_null;
+
+/*
+ * Superinstructions. At ';' a cell holding `first` that is followed by
+ * `second` is overwritten with `fused`, which runs both and skips the
+ * rest of the sequence. The other cells are left alone, so the thread
+ * keeps its length (branch offsets stay valid) and a branch into the
+ * middle of a sequence still runs the original words.
+ */
+static struct fusion {
+    const char *first, *second, *name;
+    uint8_t op;
+    struct word *a, *b, *fused;
+} fusions[] = {
+    { "LIT", "+", "LIT+", OP_LIT_PLUS, 0, 0, 0 },
+    { "LIT", "-", "LIT-", OP_LIT_MINUS, 0, 0, 0 },
+    { "LIT", "=", "LIT=", OP_LIT_EQ, 0, 0, 0 },
+    { "DUP", "0BRANCH", "DUP0BRANCH", OP_DUP_0BRANCH, 0, 0, 0 },
+    { "0=", "0BRANCH", "0=0BRANCH", OP_0EQ_0BRANCH, 0, 0, 0 },
+    { "OVER", "OVER", "OVER-OVER", OP_OVER_OVER, 0, 0, 0 },
+    { "SWAP", "DROP", "SWAP-DROP", OP_SWAP_DROP, 0, 0, 0 },
+};
 
 static char word_buf[WORD_BUF_SIZE];
 
 static char string_heap[STRING_HEAP_SIZE];
 static int string_here = 0;
 
+/* Block-buffered stdin/stdout; output is flushed before every refill */
+static unsigned char in_buf[IO_BUF_SIZE];
+static int in_pos = 0, in_len = 0;
+static char out_buf[IO_BUF_SIZE];
+static int out_len = 0;
+
+static void write_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) return;
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+static void out_flush(void) {
+    write_all(1, out_buf, (size_t)out_len);
+    out_len = 0;
+}
+
+static void out_char(char c) {
+    if (out_len == IO_BUF_SIZE) out_flush();
+    out_buf[out_len++] = c;
+}
+
+static void out_write(const char *p, size_t len) {
+    if (out_len + len > IO_BUF_SIZE) out_flush();
+    if (len >= IO_BUF_SIZE) {
+        write_all(1, p, len);
+        return;
+    }
+    memcpy(out_buf + out_len, p, len);
+    out_len += (int)len;
+}
+
 static void die(const char *msg) {
+    out_flush();
     write(2, msg, (unsigned)strlen(msg));
     write(2, "\n", 1);
     exit(1);
@@ -86,16 +248,6 @@ static Cell pop(void) {
     return stack[--sp];
 }
 
-static void rpush(Cell v) {
-    if (rsp >= RSTACK_SIZE) die("return stack overflow");
-    rstack[rsp++] = v;
-}
-
-static Cell rpop(void) {
-    if (rsp <= 0) die("return stack underflow");
-    return rstack[--rsp];
-}
-
 static int streqi(const char *a, const char *b) {
     while (*a && *b) {
         if (toupper((unsigned char)*a) != toupper((unsigned char)*b)) return 0;
@@ -105,9 +257,33 @@ static int streqi(const char *a, const char *b) {
     return *a == '\0' && *b == '\0';
 }
 
+static int normalize_name(char *dst, const char *src) {
+    int len = 0;
+    while (src[len] && len < WORD_BUF_SIZE - 1) {
+        dst[len] = (char)toupper((unsigned char)src[len]);
+        len++;
+    }
+    dst[len] = '\0';
+    return len;
+}
+
+static uint32_t hash_name(const char *s, int len) {
+    uint32_t h = 2166136261u; /* FNV-1a */
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
 static struct word *find_word(const char *name) {
-    for (struct word *w = latest; w; w = w->link) {
-        if (streqi(w->name, name)) return w;
+    char key[WORD_BUF_SIZE];
+    int len = normalize_name(key, name);
+    uint32_t h = hash_name(key, len);
+    for (struct word *w = buckets[h & (HASH_BUCKETS - 1)]; w; w = w->hash_link) {
+        if (w->hash == h && w->len == len && !(w->flags & F_HIDDEN) &&
+            memcmp(w->name, key, (size_t)len) == 0)
+            return w;
     }
     return NULL;
 }
@@ -117,56 +293,655 @@ static void dict_emit(Cell v) {
     dict[here++] = v;
 }
 
-static void exec_word(struct word *w);
+/* Thread cells followed by an inline literal or branch offset */
+static int has_operand(const struct word *w) {
+    switch (w->op) {
+    case OP_LIT:
+    case OP_BRANCH:
+    case OP_0BRANCH:
+    case OP_QDO:
+    case OP_LOOP:
+    case OP_PLUS_LOOP:
+        return 1;
+    }
+    return 0;
+}
+
+/* Whether cell c holds the xt of a registered word */
+static int is_word(Cell c) {
+    uintptr_t p = (uintptr_t)c, base_addr = (uintptr_t)words;
+    return p >= base_addr && p < (uintptr_t)&words[num_words] &&
+           (p - base_addr) % sizeof(struct word) == 0;
+}
+
+/* Stands in for a NULL cell (`' missing ,`) so the inner loop needn't check */
+static void prim_null(void) { die("null word"); }
+
+/*
+ * Marks the cells of the thread [p, p + n) that can run as words,
+ * following branches from the first cell and skipping operands. Inline
+ * data (`BRANCH [ 2 , 7 , 8 , ]`) is left unmarked; NULL cells that
+ * would run are pointed at (NULL). Caller frees.
+ */
+static char *thread_code(Cell *p, int n) {
+    char *code = calloc((size_t)n + 1, 1);
+    int *todo = malloc(((size_t)n + 1) * sizeof(*todo));
+    int top = 0;
+    if (!code || !todo) die("out of memory");
+    todo[top++] = 0;
+    while (top) {
+        int i = todo[--top];
+        while (i >= 0 && i < n && !code[i]) {
+            if (!p[i]) p[i] = (Cell)(uintptr_t)w_null;
+            if (!is_word(p[i])) break;
+            struct word *w = (struct word *)(uintptr_t)p[i];
+            code[i] = 1;
+            if (w == w_exit) break;
+            if (!has_operand(w)) {
+                i++;
+                continue;
+            }
+            if (i + 1 >= n) break;
+            if (w != w_lit) {
+                Cell t = i + 2 + p[i + 1];
+                if (t >= 0 && t < n) todo[top++] = (int)t;
+                if (w == w_branch) break;
+            }
+            i += 2;
+        }
+    }
+    free(todo);
+    return code;
+}
+
+#ifdef FORTH_PROFILE
+/* Counts of word pairs executed back to back within one thread */
+enum { PAIR_SLOTS = 4096, PAIR_REPORT = 25 };
+
+static struct pair {
+    struct word *a, *b;
+    unsigned long count;
+} pairs[PAIR_SLOTS];
+
+static void count_pair(struct word *a, struct word *b) {
+    uintptr_t h = ((uintptr_t)a >> 4) * 31 + ((uintptr_t)b >> 4);
+    for (int n = 0; n < PAIR_SLOTS; n++) {
+        struct pair *p = &pairs[(h + (uintptr_t)n) & (PAIR_SLOTS - 1)];
+        if (p->a == a && p->b == b) {
+            p->count++;
+            return;
+        }
+        if (!p->a) {
+            p->a = a;
+            p->b = b;
+            p->count = 1;
+            return;
+        }
+    }
+}
+
+static int pair_cmp(const void *x, const void *y) {
+    const struct pair *a = x, *b = y;
+    return a->count < b->count ? 1 : a->count > b->count ? -1 : 0;
+}
+
+/*
+ * Every word run, primitives included, is a node in a call tree keyed
+ * by (parent node, word), holding its calls, the thread cells it
+ * dispatched itself, and the time spent in it with and without its
+ * callees. Times are read from the cycle counter on entry and exit
+ * (CLOCK_MONOTONIC where there is none) and scaled to nanoseconds
+ * against CLOCK_MONOTONIC at the end; primitives carry the cost of two
+ * counter reads each. Inline ops (LIT,
+ * branches, loops, FORTH_FAST stack words) are not calls; their time
+ * and dispatches belong to the word whose thread holds them.
+ */
+enum { PROF_DEPTH = 2 * RSTACK_SIZE, PROF_HASH = 1 << 16 };
+
+static struct prof_node {
+    int parent;
+    struct word *w;
+    const char *name; /* names are never freed in this build */
+    unsigned long calls, dispatches;
+    uint64_t incl, excl; /* ticks of prof_now() */
+} *prof_nodes;
+static int prof_num, prof_cap;
+static int prof_hash[PROF_HASH]; /* node + 1, 0 for empty */
+
+static struct prof_frame {
+    int node;
+    uint64_t start, callees;
+} prof_stack[PROF_DEPTH];
+static int prof_depth;
+static unsigned long prof_dispatches;
+static const char *prof_folded; /* --folded file */
+
+static uint64_t prof_start_ticks, prof_start_ns;
+
+static uint64_t prof_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t prof_now(void) {
+#if defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    return prof_ns();
+#endif
+}
+
+static void prof_init(void) {
+    prof_start_ns = prof_ns();
+    prof_start_ticks = prof_now();
+}
 
-static void run_inner(void) {
-    while (ip) {
-        struct word *w = (struct word *)(uintptr_t)*ip++;
-        exec_word(w);
+static int prof_node(int parent, struct word *w) {
+    uintptr_t h = ((uintptr_t)w >> 4) * 31 + (uintptr_t)parent;
+    for (int n = 0; n < PROF_HASH; n++) {
+        int *slot = &prof_hash[(h + (uintptr_t)n) & (PROF_HASH - 1)];
+        if (*slot) {
+            struct prof_node *p = &prof_nodes[*slot - 1];
+            if (p->parent == parent && p->w == w && p->name == w->name) return *slot - 1;
+            continue;
+        }
+        if (prof_num == prof_cap) {
+            prof_cap = prof_cap ? 2 * prof_cap : 1024;
+            prof_nodes = realloc(prof_nodes, (size_t)prof_cap * sizeof(*prof_nodes));
+            if (!prof_nodes) die("out of memory");
+        }
+        prof_nodes[prof_num] = (struct prof_node){ .parent = parent, .w = w, .name = w->name };
+        *slot = ++prof_num;
+        return prof_num - 1;
     }
+    die("profile table full");
+    return 0;
 }
 
-static void do_colon(void) {
-    struct word *self = (struct word *)(uintptr_t)rpop();
-    rpush((Cell)(uintptr_t)ip);
-    ip = self->param;
-    run_inner();
+static void prof_enter(struct word *w) {
+    if (prof_depth == PROF_DEPTH) die("profile stack overflow");
+    int node = prof_node(prof_depth ? prof_stack[prof_depth - 1].node : -1, w);
+    prof_nodes[node].calls++;
+    prof_stack[prof_depth++] = (struct prof_frame){ node, prof_now(), 0 };
 }
 
-static void prim_exit(void) {
-    ip = (Cell *)(uintptr_t)rpop();
-    if (!ip) return;
+static void prof_leave(void) {
+    if (!prof_depth) return;
+    struct prof_frame *f = &prof_stack[--prof_depth];
+    uint64_t t = prof_now() - f->start;
+    prof_nodes[f->node].incl += t;
+    prof_nodes[f->node].excl += t - f->callees;
+    if (prof_depth) prof_stack[prof_depth - 1].callees += t;
 }
 
-static void prim_lit(void) {
-    push(*ip++);
+static void prof_dispatch(void) {
+    prof_dispatches++;
+    if (prof_depth) prof_nodes[prof_stack[prof_depth - 1].node].dispatches++;
 }
 
-static void prim_branch(void) {
-    Cell off = *ip++;
-    ip += off;
+/* Per-word totals, summed over every node with that name */
+static struct prof_total {
+    const char *name;
+    unsigned long calls, dispatches;
+    uint64_t incl, excl;
+} *prof_totals;
+
+static int prof_name_cmp(const void *x, const void *y) {
+    const struct prof_node *a = &prof_nodes[*(const int *)x];
+    const struct prof_node *b = &prof_nodes[*(const int *)y];
+    return strcmp(a->name, b->name);
 }
 
-static void prim_0branch(void) {
-    Cell flag = pop();
-    Cell off = *ip++;
-    if (flag == 0) ip += off;
+static int prof_total_cmp(const void *x, const void *y) {
+    const struct prof_total *a = x, *b = y;
+    return a->excl < b->excl ? 1 : a->excl > b->excl ? -1 : 0;
 }
 
+/* Inside a call of the same word, so already in that word's inclusive time */
+static int prof_recursive(int node) {
+    for (int p = prof_nodes[node].parent; p >= 0; p = prof_nodes[p].parent) {
+        if (!strcmp(prof_nodes[p].name, prof_nodes[node].name)) return 1;
+    }
+    return 0;
+}
+
+static void prof_write_folded(double ns_per_tick) {
+    FILE *f = fopen(prof_folded, "w");
+    if (!f) die("cannot write folded stacks");
+    for (int i = 0; i < prof_num; i++) {
+        if (!prof_nodes[i].excl) continue;
+        const char *path[PROF_DEPTH];
+        int n = 0;
+        for (int p = i; p >= 0 && n < PROF_DEPTH; p = prof_nodes[p].parent) path[n++] = prof_nodes[p].name;
+        while (n--) fprintf(f, "%s%c", path[n], n ? ';' : ' ');
+        fprintf(f, "%llu\n", (unsigned long long)(prof_nodes[i].excl * ns_per_tick));
+    }
+    int bad = ferror(f);
+    if (fclose(f) || bad) die("cannot write folded stacks");
+}
+
+static void profile_report(void) {
+    char line[160];
+    int n;
+    out_flush();
+    while (prof_depth) prof_leave();
+    uint64_t ticks = prof_now() - prof_start_ticks, ns = prof_ns() - prof_start_ns;
+    double ns_per_tick = ticks ? (double)ns / (double)ticks : 1.0;
+
+    qsort(pairs, PAIR_SLOTS, sizeof(pairs[0]), pair_cmp);
+    write_all(2, "word pairs (fusion candidates):\n", 32);
+    for (int i = 0; i < PAIR_REPORT && pairs[i].a; i++) {
+        n = snprintf(line, sizeof(line), "%12lu  %s %s\n", pairs[i].count,
+                     pairs[i].a->name, pairs[i].b->name);
+        write_all(2, line, (size_t)n);
+    }
+
+    int *order = malloc(((size_t)prof_num + 1) * sizeof(*order));
+    prof_totals = calloc((size_t)prof_num + 1, sizeof(*prof_totals));
+    if (!order || !prof_totals) die("out of memory");
+    for (int i = 0; i < prof_num; i++) order[i] = i;
+    qsort(order, (size_t)prof_num, sizeof(*order), prof_name_cmp);
+    int words_seen = 0;
+    for (int i = 0; i < prof_num; i++) {
+        struct prof_node *p = &prof_nodes[order[i]];
+        if (!words_seen || strcmp(prof_totals[words_seen - 1].name, p->name))
+            prof_totals[words_seen++].name = p->name;
+        struct prof_total *t = &prof_totals[words_seen - 1];
+        t->calls += p->calls;
+        t->dispatches += p->dispatches;
+        t->excl += p->excl;
+        if (!prof_recursive(order[i])) t->incl += p->incl;
+    }
+    qsort(prof_totals, (size_t)words_seen, sizeof(*prof_totals), prof_total_cmp);
+
+    n = snprintf(line, sizeof(line), "\n%lu dispatches\n%12s %12s %12s %12s  %s\n",
+                 prof_dispatches, "calls", "dispatches", "incl ms", "excl ms", "word");
+    write_all(2, line, (size_t)n);
+    for (int i = 0; i < words_seen; i++) {
+        struct prof_total *t = &prof_totals[i];
+        n = snprintf(line, sizeof(line), "%12lu %12lu %12.3f %12.3f  %s\n", t->calls,
+                     t->dispatches, t->incl * ns_per_tick / 1e6, t->excl * ns_per_tick / 1e6,
+                     t->name);
+        write_all(2, line, (size_t)n);
+    }
+    free(order);
+    if (prof_folded) prof_write_folded(ns_per_tick);
+}
+#define PROFILE_PAIR(w) do { \
+        prof_dispatch(); \
+        if (prev) count_pair(prev, w); \
+        prev = (w); \
+    } while (0)
+#define PROFILE_BREAK() (prev = NULL)
+#define PROFILE_ENTER(w) prof_enter(w)
+#define PROFILE_LEAVE() prof_leave()
+#else
+#define PROFILE_PAIR(w) ((void)0)
+#define PROFILE_BREAK() ((void)0)
+#define PROFILE_ENTER(w) ((void)0)
+#define PROFILE_LEAVE() ((void)0)
+#endif
+
+/* =============================
+ * Inner interpreter
+ * ============================= */
+
+/* Ends the two-cell thread exec_word() starts from */
+static struct word halt_word = { .name = "(HALT)", .op = OP_HALT };
+
+/*
+ * Runs w to completion in one flat loop. Colon calls push the return
+ * address on rstack instead of recursing; ip and the return stack
+ * pointer stay in locals until the thread halts.
+ */
 static void exec_word(struct word *w) {
+    Cell start[2] = { (Cell)(uintptr_t)w, (Cell)(uintptr_t)&halt_word };
+    Cell *ip = start;
+    Cell *rp = &rstack[rsp];
+    Cell flag, off, index, limit;
+#ifdef FORTH_PROFILE
+    struct word *prev = NULL;
+#endif
+
     if (!w) die("null word");
-    if (w->code == do_colon) {
-        rpush((Cell)(uintptr_t)w);
-        do_colon();
+    if (w->code) {
+        /* Primitives run outside a thread keep their checked C version */
+        PROFILE_ENTER(w);
+        w->code();
+        PROFILE_LEAVE();
         return;
     }
-    w->code();
+#ifdef FORTH_FAST
+    /* dsp is the slot tos belongs in; depth is dsp - stack + 1 */
+    Cell tos, a, *dsp;
+#define DPUSH(v) (*dsp++ = tos, tos = (v))
+#define DPOP(x) ((x) = tos, tos = *--dsp)
+#define SPILL() (*dsp = tos, sp = (int)(dsp - stack) + 1)
+#define RELOAD() (dsp = &stack[sp - 1], tos = *dsp)
+#define CHECK_DEPTH() do { \
+        if (dsp < stack - 1) die("stack underflow"); \
+        if (dsp >= stack + STACK_SIZE) die("stack overflow"); \
+    } while (0)
+#define BINOP(expr) do { a = *--dsp; tos = (expr); } while (0)
+#define TOP() tos
+#define NEED(n) ((void)0)
+    RELOAD();
+#else
+#define DPUSH(v) push(v)
+#define DPOP(x) ((x) = pop())
+#define TOP() stack[sp - 1]
+#define NEED(n) do { if (sp < (n)) die("stack underflow"); } while (0)
+#define SPILL() ((void)0)
+#define RELOAD() ((void)0)
+#define CHECK_DEPTH() ((void)0)
+#endif
+
+#ifdef USE_COMPUTED_GOTO
+    static void *const labels[] = {
+        [OP_PRIM] = &&op_prim,       [OP_COLON] = &&op_colon,
+        [OP_EXIT] = &&op_exit,       [OP_LIT] = &&op_lit,
+        [OP_BRANCH] = &&op_branch,   [OP_0BRANCH] = &&op_0branch,
+        [OP_EXECUTE] = &&op_execute, [OP_HALT] = &&op_halt,
+        [OP_DO] = &&op_do,           [OP_QDO] = &&op_qdo,
+        [OP_LOOP] = &&op_loop,       [OP_PLUS_LOOP] = &&op_plus_loop,
+        [OP_I] = &&op_i,             [OP_J] = &&op_j,
+        [OP_UNLOOP] = &&op_unloop,
+        [OP_CONSTANT] = &&op_constant, [OP_VALUE] = &&op_value,
+        [OP_CREATE] = &&op_create,   [OP_DOES] = &&op_does,
+        [OP_SET_DOES] = &&op_set_does,
+        [OP_LIT_PLUS] = &&op_lit_plus,
+        [OP_LIT_MINUS] = &&op_lit_minus,
+        [OP_LIT_EQ] = &&op_lit_eq,
+        [OP_DUP_0BRANCH] = &&op_dup_0branch,
+        [OP_0EQ_0BRANCH] = &&op_0eq_0branch,
+        [OP_OVER_OVER] = &&op_over_over,
+        [OP_SWAP_DROP] = &&op_swap_drop,
+#ifdef FORTH_FAST
+        [OP_DUP] = &&op_dup,         [OP_DROP] = &&op_drop,
+        [OP_SWAP] = &&op_swap,       [OP_OVER] = &&op_over,
+        [OP_ROT] = &&op_rot,         [OP_NIP] = &&op_nip,
+        [OP_TUCK] = &&op_tuck,       [OP_QDUP] = &&op_qdup,
+        [OP_2DUP] = &&op_2dup,       [OP_2DROP] = &&op_2drop,
+        [OP_PLUS] = &&op_plus,       [OP_MINUS] = &&op_minus,
+        [OP_STAR] = &&op_star,       [OP_NEGATE] = &&op_negate,
+        [OP_2STAR] = &&op_2star,     [OP_2SLASH] = &&op_2slash,
+        [OP_MIN] = &&op_min,         [OP_MAX] = &&op_max,
+        [OP_LT] = &&op_lt,           [OP_GT] = &&op_gt,
+        [OP_EQ] = &&op_eq,           [OP_0EQ] = &&op_0eq,
+#endif
+    };
+#define DISPATCH() goto *labels[w->op]
+#define CASE(op, label) label:
+#else
+#define DISPATCH() goto dispatch
+#define CASE(op, label) case op:
+#endif
+#define NEXT() do { \
+        w = (struct word *)(uintptr_t)*ip++; \
+        PROFILE_PAIR(w); \
+        DISPATCH(); \
+    } while (0)
+
+    NEXT();
+#ifndef USE_COMPUTED_GOTO
+dispatch:
+    switch (w->op) {
+#endif
+    CASE(OP_PRIM, op_prim)
+        CHECK_DEPTH();
+        SPILL();
+        rsp = (int)(rp - rstack); /* for native code and nested threads */
+        PROFILE_ENTER(w);
+        w->code();
+        PROFILE_LEAVE();
+        RELOAD();
+        NEXT();
+    CASE(OP_COLON, op_colon)
+        CHECK_DEPTH();
+        if (rp == &rstack[RSTACK_SIZE]) die("return stack overflow");
+        *rp++ = (Cell)(uintptr_t)ip;
+        ip = w->param;
+        PROFILE_BREAK();
+        PROFILE_ENTER(w);
+        NEXT();
+    CASE(OP_EXIT, op_exit)
+        CHECK_DEPTH();
+        if (rp == rstack) die("return stack underflow");
+        ip = (Cell *)(uintptr_t)*--rp;
+        PROFILE_BREAK();
+        PROFILE_LEAVE();
+        NEXT();
+    CASE(OP_LIT, op_lit)
+        DPUSH(*ip++);
+        NEXT();
+    CASE(OP_BRANCH, op_branch)
+        CHECK_DEPTH();
+        off = *ip++;
+        ip += off;
+        PROFILE_BREAK();
+        NEXT();
+    CASE(OP_0BRANCH, op_0branch)
+        DPOP(flag);
+        CHECK_DEPTH();
+        off = *ip++;
+        if (flag == 0) ip += off;
+        NEXT();
+    CASE(OP_LIT_PLUS, op_lit_plus)
+        NEED(1);
+        TOP() += ip[0];
+        ip += 2;
+        NEXT();
+    CASE(OP_LIT_MINUS, op_lit_minus)
+        NEED(1);
+        TOP() -= ip[0];
+        ip += 2;
+        NEXT();
+    CASE(OP_LIT_EQ, op_lit_eq)
+        NEED(1);
+        TOP() = TOP() == ip[0] ? -1 : 0;
+        ip += 2;
+        NEXT();
+    CASE(OP_DUP_0BRANCH, op_dup_0branch)
+        NEED(1);
+        CHECK_DEPTH();
+        off = ip[1];
+        ip += 2;
+        if (TOP() == 0) ip += off;
+        NEXT();
+    CASE(OP_0EQ_0BRANCH, op_0eq_0branch)
+        DPOP(flag);
+        CHECK_DEPTH();
+        off = ip[1];
+        ip += 2;
+        if (flag != 0) ip += off;
+        NEXT();
+    CASE(OP_OVER_OVER, op_over_over)
+        NEED(2);
+#ifdef FORTH_FAST
+        *dsp = tos;
+        dsp[1] = dsp[-1];
+        dsp += 2;
+#else
+        push(stack[sp - 2]);
+        push(stack[sp - 2]);
+#endif
+        ip += 1;
+        NEXT();
+    CASE(OP_SWAP_DROP, op_swap_drop)
+        NEED(2);
+#ifdef FORTH_FAST
+        dsp--;
+#else
+        stack[sp - 2] = stack[sp - 1];
+        sp--;
+#endif
+        ip += 1;
+        NEXT();
+    CASE(OP_EXECUTE, op_execute)
+        DPOP(flag);
+        CHECK_DEPTH();
+        w = (struct word *)(uintptr_t)flag;
+        if (!w) die("null word");
+        PROFILE_BREAK();
+        DISPATCH();
+    CASE(OP_HALT, op_halt)
+        CHECK_DEPTH();
+        SPILL();
+        rsp = (int)(rp - rstack);
+        return;
+    CASE(OP_QDO, op_qdo)
+        DPOP(index);
+        DPOP(limit);
+        CHECK_DEPTH();
+        off = *ip++;
+        if (index == limit) {
+            ip += off;
+            PROFILE_BREAK();
+            NEXT();
+        }
+        if (rp > &rstack[RSTACK_SIZE - 2]) die("return stack overflow");
+        rp[0] = limit;
+        rp[1] = index;
+        rp += 2;
+        NEXT();
+    CASE(OP_DO, op_do)
+        DPOP(index);
+        DPOP(limit);
+        CHECK_DEPTH();
+        if (rp > &rstack[RSTACK_SIZE - 2]) die("return stack overflow");
+        rp[0] = limit;
+        rp[1] = index;
+        rp += 2;
+        NEXT();
+    CASE(OP_LOOP, op_loop)
+        CHECK_DEPTH();
+        if (rp < &rstack[2]) die("return stack underflow");
+        off = *ip++;
+        if (++rp[-1] != rp[-2]) {
+            ip += off;
+            PROFILE_BREAK();
+        } else {
+            rp -= 2;
+        }
+        NEXT();
+    CASE(OP_PLUS_LOOP, op_plus_loop)
+        DPOP(flag);
+        CHECK_DEPTH();
+        if (rp < &rstack[2]) die("return stack underflow");
+        off = *ip++;
+        /* Done when the index crosses from limit-1 to limit, either way */
+        index = (Cell)((uintptr_t)rp[-1] - (uintptr_t)rp[-2]);
+        rp[-1] = (Cell)((uintptr_t)rp[-1] + (uintptr_t)flag);
+        if (((index ^ (Cell)((uintptr_t)index + (uintptr_t)flag)) & (index ^ flag)) < 0) {
+            rp -= 2;
+        } else {
+            ip += off;
+            PROFILE_BREAK();
+        }
+        NEXT();
+    CASE(OP_I, op_i)
+        if (rp < &rstack[2]) die("return stack underflow");
+        DPUSH(rp[-1]);
+        NEXT();
+    CASE(OP_J, op_j)
+        if (rp < &rstack[4]) die("return stack underflow");
+        DPUSH(rp[-3]);
+        NEXT();
+    CASE(OP_UNLOOP, op_unloop)
+        if (rp < &rstack[2]) die("return stack underflow");
+        rp -= 2;
+        NEXT();
+    CASE(OP_CONSTANT, op_constant)
+    CASE(OP_VALUE, op_value)
+        DPUSH(*w->param);
+        NEXT();
+    CASE(OP_CREATE, op_create)
+        DPUSH((Cell)(uintptr_t)w->param);
+        NEXT();
+    CASE(OP_DOES, op_does)
+        DPUSH((Cell)(uintptr_t)w->param);
+        CHECK_DEPTH();
+        if (rp == &rstack[RSTACK_SIZE]) die("return stack overflow");
+        *rp++ = (Cell)(uintptr_t)ip;
+        ip = w->does;
+        PROFILE_BREAK();
+        PROFILE_ENTER(w);
+        NEXT();
+    CASE(OP_SET_DOES, op_set_does)
+        /* The rest of this thread becomes the latest word's action */
+        CHECK_DEPTH();
+        if (!latest || (latest->op != OP_CREATE && latest->op != OP_DOES))
+            die("DOES> without CREATE");
+        latest->op = OP_DOES;
+        latest->does = ip;
+        if (rp == rstack) die("return stack underflow");
+        ip = (Cell *)(uintptr_t)*--rp;
+        PROFILE_BREAK();
+        PROFILE_LEAVE();
+        NEXT();
+#ifdef FORTH_FAST
+    CASE(OP_DUP, op_dup)       *dsp++ = tos; NEXT();
+    CASE(OP_DROP, op_drop)     tos = *--dsp; NEXT();
+    CASE(OP_SWAP, op_swap)     a = dsp[-1]; dsp[-1] = tos; tos = a; NEXT();
+    CASE(OP_OVER, op_over)     *dsp = tos; tos = dsp[-1]; dsp++; NEXT();
+    CASE(OP_ROT, op_rot)
+        a = dsp[-2];
+        dsp[-2] = dsp[-1];
+        dsp[-1] = tos;
+        tos = a;
+        NEXT();
+    CASE(OP_NIP, op_nip)       dsp--; NEXT();
+    CASE(OP_TUCK, op_tuck)     *dsp = dsp[-1]; dsp[-1] = tos; dsp++; NEXT();
+    CASE(OP_QDUP, op_qdup)     if (tos) *dsp++ = tos; NEXT();
+    CASE(OP_2DUP, op_2dup)     *dsp = tos; dsp[1] = dsp[-1]; dsp += 2; NEXT();
+    CASE(OP_2DROP, op_2drop)   dsp -= 2; tos = *dsp; NEXT();
+    CASE(OP_PLUS, op_plus)     BINOP(a + tos); NEXT();
+    CASE(OP_MINUS, op_minus)   BINOP(a - tos); NEXT();
+    CASE(OP_STAR, op_star)     BINOP(a * tos); NEXT();
+    CASE(OP_NEGATE, op_negate) tos = -tos; NEXT();
+    CASE(OP_2STAR, op_2star)   tos *= 2; NEXT();
+    CASE(OP_2SLASH, op_2slash) tos /= 2; NEXT();
+    CASE(OP_MIN, op_min)       BINOP(a < tos ? a : tos); NEXT();
+    CASE(OP_MAX, op_max)       BINOP(a > tos ? a : tos); NEXT();
+    CASE(OP_LT, op_lt)         BINOP(a < tos ? -1 : 0); NEXT();
+    CASE(OP_GT, op_gt)         BINOP(a > tos ? -1 : 0); NEXT();
+    CASE(OP_EQ, op_eq)         BINOP(a == tos ? -1 : 0); NEXT();
+    CASE(OP_0EQ, op_0eq)       tos = tos == 0 ? -1 : 0; NEXT();
+#endif
+#ifndef USE_COMPUTED_GOTO
+    default:
+        die("bad opcode");
+    }
+#endif
+#undef NEXT
+#undef CASE
+#undef DISPATCH
+#undef DPUSH
+#undef DPOP
+#undef SPILL
+#undef RELOAD
+#undef CHECK_DEPTH
+#undef TOP
+#undef NEED
+#ifdef FORTH_FAST
+#undef BINOP
+#endif
 }
 
 static int read_char(void) {
-    unsigned char c;
-    if (read(0, &c, 1) <= 0) return -1;
-    return c;
+    if (in_pos == in_len) {
+        out_flush();
+        ssize_t n = read(0, in_buf, sizeof(in_buf));
+        if (n <= 0) return -1;
+        in_pos = 0;
+        in_len = (int)n;
+    }
+    return in_buf[in_pos++];
 }
 
 static int read_word(char *buf, int maxlen) {
@@ -288,18 +1063,100 @@ static void prim_gt(void) { Cell b = pop(), a = pop(); push(a > b ? -1 : 0); }
 static void prim_eq(void) { Cell b = pop(), a = pop(); push(a == b ? -1 : 0); }
 static void prim_0eq(void) { push(pop() == 0 ? -1 : 0); }
 
-static void prim_emit(void) {
-    char c = (char)pop();
-    write(1, &c, 1);
-}
-
-static void prim_space(void) { write(1, " ", 1); }
-static void prim_cr(void) { write(1, "\n", 1); }
+static void prim_emit(void) { out_char((char)pop()); }
+static void prim_space(void) { out_char(' '); }
+static void prim_cr(void) { out_char('\n'); }
 
 static void prim_type(void) {
     Cell len = pop();
     const char *addr = (const char *)(uintptr_t)pop();
-    if (len > 0) write(1, addr, (size_t)len);
+    if (len > 0) out_write(addr, (size_t)len);
+}
+
+static void prim_flush(void) { out_flush(); }
+
+/* Byte counts below zero move nothing */
+static size_t pop_count(void) {
+    Cell u = pop();
+    return u > 0 ? (size_t)u : 0;
+}
+
+/* CMOVE ( src dst u ) copies upwards, CMOVE> downwards, byte by byte */
+static void prim_cmove(void) {
+    size_t u = pop_count();
+    uint8_t *dst = (uint8_t *)(uintptr_t)pop();
+    const uint8_t *src = (const uint8_t *)(uintptr_t)pop();
+    if ((uintptr_t)dst <= (uintptr_t)src || (uintptr_t)dst >= (uintptr_t)src + u) {
+        if (u) memmove(dst, src, u);
+        return;
+    }
+    /* dst overlaps the end of src: the copy repeats the leading bytes */
+    for (size_t i = 0; i < u; i++) dst[i] = src[i];
+}
+
+static void prim_cmove_up(void) {
+    size_t u = pop_count();
+    uint8_t *dst = (uint8_t *)(uintptr_t)pop();
+    const uint8_t *src = (const uint8_t *)(uintptr_t)pop();
+    if ((uintptr_t)dst >= (uintptr_t)src || (uintptr_t)dst + u <= (uintptr_t)src) {
+        if (u) memmove(dst, src, u);
+        return;
+    }
+    while (u--) dst[u] = src[u];
+}
+
+static void prim_move(void) {
+    size_t u = pop_count();
+    void *dst = (void *)(uintptr_t)pop();
+    const void *src = (const void *)(uintptr_t)pop();
+    if (u) memmove(dst, src, u);
+}
+
+static void prim_fill(void) {
+    int c = (int)(uint8_t)pop();
+    size_t u = pop_count();
+    void *addr = (void *)(uintptr_t)pop();
+    if (u) memset(addr, c, u);
+}
+
+/* COMPARE ( a1 u1 a2 u2 -- n ) n = -1, 0 or 1 */
+static void prim_compare(void) {
+    size_t u2 = pop_count();
+    const char *a2 = (const char *)(uintptr_t)pop();
+    size_t u1 = pop_count();
+    const char *a1 = (const char *)(uintptr_t)pop();
+    size_t n = u1 < u2 ? u1 : u2;
+    int r = n ? memcmp(a1, a2, n) : 0;
+    if (r == 0) r = (u1 > u2) - (u1 < u2);
+    push(r < 0 ? -1 : r > 0 ? 1 : 0);
+}
+
+/* SEARCH ( a1 u1 a2 u2 -- a3 u3 flag ) a3 u3 is the rest of a1 u1 from the match */
+static void prim_search(void) {
+    size_t u2 = pop_count();
+    const char *a2 = (const char *)(uintptr_t)pop();
+    Cell len = pop();
+    const char *a1 = (const char *)(uintptr_t)pop();
+    size_t u1 = len > 0 ? (size_t)len : 0;
+    const char *p = a1;
+
+    if (u2 <= u1) {
+        const char *last = a1 + (u1 - u2);
+        while (u2 && p <= last) {
+            p = memchr(p, a2[0], (size_t)(last - p) + 1);
+            if (!p || memcmp(p, a2, u2) == 0) break;
+            p++;
+        }
+        if (p && p <= last) {
+            push((Cell)(uintptr_t)p);
+            push((Cell)(u1 - (size_t)(p - a1)));
+            push(-1);
+            return;
+        }
+    }
+    push((Cell)(uintptr_t)a1);
+    push(len);
+    push(0);
 }
 
 static void prim_dot(void) {
@@ -315,11 +1172,17 @@ static void prim_dot(void) {
         n /= base;
     }
     if (neg) buf[i++] = '-';
-    while (i--) write(1, &buf[i], 1);
-    write(1, " ", 1);
+    while (i--) out_char(buf[i]);
+    out_char(' ');
 }
 
-static void prim_bye(void) { exit(0); }
+static void prim_bye(void) {
+    out_flush();
+#ifdef FORTH_PROFILE
+    profile_report();
+#endif
+    exit(0);
+}
 
 static void prim_here(void) {
     push((Cell)(uintptr_t)&dict[here]);
@@ -348,6 +1211,13 @@ static void prim_ccomma(void) {
     here = (byte_here + (int)sizeof(Cell) - 1) / (int)sizeof(Cell);
 }
 
+static void prim_fetch(void) { push(*(Cell *)(uintptr_t)pop()); }
+
+static void prim_store(void) {
+    Cell *a = (Cell *)(uintptr_t)pop();
+    *a = pop();
+}
+
 static void prim_state(void) { push((Cell)(uintptr_t)&state); }
 static void prim_base(void) { push((Cell)(uintptr_t)&base); }
 
@@ -359,34 +1229,795 @@ static void prim_immediate(void) {
     latest->flags |= F_IMMED;
 }
 
+static void prim_hidden(void) {
+    if (!latest) die("no latest");
+    latest->flags ^= F_HIDDEN;
+}
+
+/* Compile a call to the word being defined (hidden until ;) */
+static void prim_recurse(void) {
+    if (!latest) die("no latest");
+    dict_emit((Cell)(uintptr_t)latest);
+}
+
 static void prim_tick(void) {
     if (!read_word(word_buf, WORD_BUF_SIZE)) { push(0); return; }
     struct word *w = find_word(word_buf);
     push((Cell)(uintptr_t)w);
 }
 
-static void prim_execute(void) {
-    struct word *w = (struct word *)(uintptr_t)pop();
-    exec_word(w);
-}
+static struct word *new_word(const char *name, codefn fn, uint8_t flags);
 
 static void prim_colon(void) {
     if (!read_word(word_buf, WORD_BUF_SIZE)) die("missing name");
 
-    struct word *w = &words[num_words++];
-    memset(w, 0, sizeof(*w));
-    w->name = strdup(word_buf);
-    w->link = latest;
-    w->flags = 0;
-    w->code = do_colon;
+    struct word *w = new_word(word_buf, NULL, F_HIDDEN);
+    w->op = OP_COLON;
     w->param = &dict[here];
-    latest = w;
     state = 1;
 }
 
+/* =============================
+ * Data words
+ * ============================= */
+
+/*
+ * CONSTANT, VALUE and VARIABLE keep their cell in the dictionary at
+ * param, and CREATE points param at the space that follows. Compiling a reference to a constant or to a
+ * CREATE/VARIABLE word (before DOES>) emits LIT with the value or
+ * address itself, so those cost one dispatch and no call. Values are
+ * not folded because TO changes them.
+ */
+static struct word *data_word(uint8_t op) {
+    if (!read_word(word_buf, WORD_BUF_SIZE)) die("missing name");
+    struct word *w = new_word(word_buf, NULL, 0);
+    w->op = op;
+    w->param = &dict[here];
+    return w;
+}
+
+static void prim_constant(void) {
+    Cell n = pop();
+    data_word(OP_CONSTANT);
+    dict_emit(n);
+}
+
+static void prim_value(void) {
+    Cell n = pop();
+    data_word(OP_VALUE);
+    dict_emit(n);
+}
+
+static void prim_variable(void) {
+    data_word(OP_CREATE);
+    dict_emit(0);
+}
+
+static void prim_create(void) { data_word(OP_CREATE); }
+
+static void prim_to(void) {
+    if (!read_word(word_buf, WORD_BUF_SIZE)) die("missing name");
+    struct word *w = find_word(word_buf);
+    if (!w || w->op != OP_VALUE) die("TO needs a VALUE");
+    if (state) {
+        dict_emit((Cell)(uintptr_t)w_lit);
+        dict_emit((Cell)(uintptr_t)w->param);
+        dict_emit((Cell)(uintptr_t)w_store);
+    } else {
+        *w->param = pop();
+    }
+}
+
+static void prim_does(void) { dict_emit((Cell)(uintptr_t)w_set_does); }
+
+/* Append w to the definition being compiled */
+static void compile_word(struct word *w) {
+    if (w->op == OP_CONSTANT) {
+        dict_emit((Cell)(uintptr_t)w_lit);
+        dict_emit(*w->param);
+    } else if (w->op == OP_CREATE) {
+        dict_emit((Cell)(uintptr_t)w_lit);
+        dict_emit((Cell)(uintptr_t)w->param);
+    } else {
+        dict_emit((Cell)(uintptr_t)w);
+    }
+}
+
+/* =============================
+ * Counted loops
+ * ============================= */
+
+enum { LOOP_NEST = 16, MAX_LEAVES = 64 };
+
+/* DO loops still open in the definition being compiled */
+static struct loop_frame {
+    int body;   /* first cell of the loop body */
+    int leaves; /* its first entry in leave_sites */
+} loops[LOOP_NEST];
+static int loop_depth = 0;
+
+/* Offset cells that jump past the innermost loops, patched at LOOP */
+static int leave_sites[MAX_LEAVES];
+static int num_leaves = 0;
+
+static void add_leave(void) {
+    if (num_leaves == MAX_LEAVES) die("too many LEAVEs");
+    leave_sites[num_leaves++] = here;
+    dict_emit(0);
+}
+
+static void begin_loop(struct word *w) {
+    if (loop_depth == LOOP_NEST) die("DO nested too deep");
+    loops[loop_depth].leaves = num_leaves;
+    dict_emit((Cell)(uintptr_t)w);
+    if (w == w_qdo) add_leave(); /* skips the loop when index = limit */
+    loops[loop_depth].body = here;
+    loop_depth++;
+}
+
+static void end_loop(struct word *w) {
+    if (loop_depth == 0) die("LOOP without DO");
+    struct loop_frame *f = &loops[--loop_depth];
+    dict_emit((Cell)(uintptr_t)w);
+    dict_emit(f->body - (here + 1));
+    while (num_leaves > f->leaves) {
+        int site = leave_sites[--num_leaves];
+        dict[site] = here - (site + 1);
+    }
+}
+
+static void prim_do(void) { begin_loop(w_do); }
+static void prim_qdo(void) { begin_loop(w_qdo); }
+static void prim_loop(void) { end_loop(w_loop); }
+static void prim_plus_loop(void) { end_loop(w_plus_loop); }
+
+static void prim_leave(void) {
+    if (loop_depth == 0) die("LEAVE outside DO");
+    dict_emit((Cell)(uintptr_t)w_unloop);
+    dict_emit((Cell)(uintptr_t)w_branch);
+    add_leave();
+}
+
+/* =============================
+ * x86-64 native code (FORTH_JIT)
+ * ============================= */
+
+#ifdef FORTH_JIT
+/*
+ * At ';' a colon definition is translated to a subroutine-threaded
+ * native function and becomes a primitive whose code is that function.
+ * Common stack/arithmetic words and LIT/BRANCH/0BRANCH/EXIT are
+ * inlined with the same checks and messages as their C versions;
+ * other words are called. The data stack stays in stack[], with sp
+ * cached in r12d and written back around calls into C, so primitives
+ * and the interpreter see it unchanged. rsp, cached in r13d, counts
+ * native frames so return stack overflow hits at the same depth as in
+ * the interpreter.
+ *
+ * Each function is a fixed-size entry for C callers, which sets up
+ * rbx = stack, r12d = sp and r13d = rsp, followed at JIT_ENTRY by the
+ * body that native callers call directly with those already in place.
+ * Straight runs of inlined words check the depth once up front. Each
+ * function starts on a fresh page that is written while RW and then
+ * switched to RX, so no page is ever writable and executable at once.
+ */
+enum {
+    JIT_REGION = 16 << 20,
+    JIT_ENTRY = 96,     /* offset of the body called from native code */
+    JIT_UNDERFLOW = -1, /* jump targets besides cell indexes */
+    JIT_OVERFLOW = -2,
+    JIT_RSTACK_OVERFLOW = -3,
+    JIT_RSTACK_UNDERFLOW = -4,
+};
+
+static uint8_t *jit_region;
+static size_t jit_used, jit_page;
+
+static uint8_t *jit_buf;
+static size_t jit_len, jit_cap;
+static uint8_t *jit_base; /* where the function being built will live */
+
+/*
+ * Unchecked runs address the stack relative to the sp they started at.
+ * The cell a push leaves in rdx is only stored once other code is
+ * emitted, so a pop straight after it costs nothing.
+ */
+static int jit_unchecked, jit_cur, jit_lo, jit_hi, jit_pending;
+
+static struct jit_fixup {
+    size_t at;  /* rel32 field */
+    int target; /* cell index or JIT_* stub */
+} *jit_fix;
+static int jit_nfix, jit_fixcap;
+
+static void jit_put(const void *p, size_t n) {
+    if (!n) return;
+    if (jit_len + n > jit_cap) {
+        while (jit_len + n > jit_cap) jit_cap = jit_cap ? jit_cap * 2 : 4096;
+        jit_buf = realloc(jit_buf, jit_cap);
+        if (!jit_buf) die("out of memory");
+    }
+    memcpy(jit_buf + jit_len, p, n);
+    jit_len += n;
+}
+
+static void jit_emit(const void *p, size_t n) {
+    if (jit_pending) {
+        int32_t disp = (jit_cur - 1) * 8;
+        static const uint8_t store[] = { 0x4A, 0x89, 0x94, 0xE3 }; /* mov [rbx + r12*8 + disp], rdx */
+        jit_pending = 0;
+        jit_put(store, sizeof(store));
+        jit_put(&disp, 4);
+    }
+    jit_put(p, n);
+}
+
+#define JIT(...) do { \
+        static const uint8_t b_[] = { __VA_ARGS__ }; \
+        jit_emit(b_, sizeof(b_)); \
+    } while (0)
+
+static void jit_u32(uint32_t v) { jit_emit(&v, 4); }
+static void jit_u64(uint64_t v) { jit_emit(&v, 8); }
+
+/* Emits the rel32 of a jump/call whose opcode is already out */
+static void jit_rel32(int target) {
+    if (jit_nfix == jit_fixcap) {
+        jit_fixcap = jit_fixcap ? jit_fixcap * 2 : 64;
+        jit_fix = realloc(jit_fix, (size_t)jit_fixcap * sizeof(*jit_fix));
+        if (!jit_fix) die("out of memory");
+    }
+    jit_fix[jit_nfix].at = jit_len;
+    jit_fix[jit_nfix].target = target;
+    jit_nfix++;
+    jit_u32(0);
+}
+
+/* eax <-> an int global, through a 64-bit absolute address */
+static void jit_load_eax(const int *var) {
+    JIT(0xA1);                      /* mov eax, [var] */
+    jit_u64((uint64_t)(uintptr_t)var);
+}
+
+static void jit_store_eax(const int *var) {
+    JIT(0xA3);                      /* mov [var], eax */
+    jit_u64((uint64_t)(uintptr_t)var);
+}
+
+/* sp and rsp to and from memory, around calls into C */
+static void jit_spill_sp(void) {
+    JIT(0x44, 0x89, 0xE0);          /* mov eax, r12d */
+    jit_store_eax(&sp);
+    JIT(0x44, 0x89, 0xE8);          /* mov eax, r13d */
+    jit_store_eax(&rsp);
+}
+
+static void jit_reload_sp(void) {
+    jit_load_eax(&sp);
+    JIT(0x41, 0x89, 0xC4);          /* mov r12d, eax */
+    jit_load_eax(&rsp);
+    JIT(0x41, 0x89, 0xC5);          /* mov r13d, eax */
+}
+
+static void jit_call(const void *fn) {
+    if ((const uint8_t *)fn >= jit_region && (const uint8_t *)fn < jit_region + JIT_REGION) {
+        int64_t rel = (const uint8_t *)fn + JIT_ENTRY - (jit_base + jit_len + 5);
+        JIT(0xE8);                  /* call fn body */
+        jit_u32((uint32_t)(int32_t)rel);
+        return;
+    }
+    jit_spill_sp();
+    JIT(0x48, 0xB8);                /* mov rax, fn */
+    jit_u64((uint64_t)(uintptr_t)fn);
+    JIT(0xFF, 0xD0);                /* call rax */
+    jit_reload_sp();
+}
+
+static void jit_call_die(const char *msg) {
+    JIT(0x48, 0xBF);                /* mov rdi, msg */
+    jit_u64((uint64_t)(uintptr_t)msg);
+    JIT(0x48, 0xB8);                /* mov rax, die */
+    jit_u64((uint64_t)(uintptr_t)die);
+    JIT(0xFF, 0xD0);                /* call rax */
+}
+
+/* pop() into rdx */
+static void jit_pop(void) {
+    if (jit_unchecked) {
+        if (1 - jit_cur > jit_lo) jit_lo = 1 - jit_cur;
+        jit_cur--;
+        if (jit_pending) {
+            jit_pending = 0;
+            return;
+        }
+        JIT(0x4A, 0x8B, 0x94, 0xE3); /* mov rdx, [rbx + r12*8 + disp] */
+        jit_u32((uint32_t)(jit_cur * 8));
+        return;
+    }
+    JIT(0x45, 0x85, 0xE4,           /* test r12d, r12d */
+        0x0F, 0x8E);                /* jle underflow */
+    jit_rel32(JIT_UNDERFLOW);
+    JIT(0x41, 0xFF, 0xCC,           /* dec r12d */
+        0x4A, 0x8B, 0x14, 0xE3);    /* mov rdx, [rbx + r12*8] */
+}
+
+/* push(rdx) */
+static void jit_push(void) {
+    if (jit_unchecked) {
+        if (STACK_SIZE - 1 - jit_cur < jit_hi) jit_hi = STACK_SIZE - 1 - jit_cur;
+        jit_emit(NULL, 0);          /* store the previous one */
+        jit_cur++;
+        jit_pending = 1;
+        return;
+    }
+    JIT(0x41, 0x81, 0xFC);          /* cmp r12d, STACK_SIZE */
+    jit_u32(STACK_SIZE);
+    JIT(0x0F, 0x8D);                /* jge overflow */
+    jit_rel32(JIT_OVERFLOW);
+    JIT(0x4A, 0x89, 0x14, 0xE3,     /* mov [rbx + r12*8], rdx */
+        0x41, 0xFF, 0xC4);          /* inc r12d */
+}
+
+/* b = pop() in rcx, a = pop() in rdx */
+static void jit_pop2(void) {
+    jit_pop();
+    JIT(0x48, 0x89, 0xD1);          /* mov rcx, rdx */
+    jit_pop();
+}
+
+/* push(flag ? -1 : 0) for the condition code setcc sets */
+static void jit_push_flag(uint8_t setcc) {
+    uint8_t set[] = { 0x0F, setcc, 0xC0 }; /* setcc al */
+    jit_emit(set, sizeof(set));
+    JIT(0x0F, 0xB6, 0xD0,           /* movzx edx, al */
+        0x48, 0xF7, 0xDA);          /* neg rdx */
+    jit_push();
+}
+
+static void jit_epilogue(void) {
+    JIT(0x41, 0xFF, 0xCD,           /* dec r13d */
+        0x48, 0x83, 0xC4, 0x08,     /* add rsp, 8 */
+        0xC3);                      /* ret */
+}
+
+/* Inline the C primitive fn; 0 if it is not one we inline */
+static int jit_inline(codefn fn) {
+    if (fn == prim_dup) {
+        jit_pop();
+        jit_push();
+        jit_push();
+    } else if (fn == prim_drop) {
+        jit_pop();
+    } else if (fn == prim_nip) {
+        jit_pop();
+        JIT(0x48, 0x89, 0xD1);      /* mov rcx, rdx */
+        jit_pop();
+        JIT(0x48, 0x89, 0xCA);      /* mov rdx, rcx */
+        jit_push();
+    } else if (fn == prim_swap) {
+        jit_pop2();
+        JIT(0x48, 0x89, 0xD6,       /* mov rsi, rdx */
+            0x48, 0x89, 0xCA);      /* mov rdx, rcx */
+        jit_push();
+        JIT(0x48, 0x89, 0xF2);      /* mov rdx, rsi */
+        jit_push();
+    } else if (fn == prim_over) {
+        jit_pop2();
+        JIT(0x48, 0x89, 0xD6);      /* mov rsi, rdx */
+        jit_push();
+        JIT(0x48, 0x89, 0xCA);      /* mov rdx, rcx */
+        jit_push();
+        JIT(0x48, 0x89, 0xF2);      /* mov rdx, rsi */
+        jit_push();
+    } else if (fn == prim_plus) {
+        jit_pop2();
+        JIT(0x48, 0x01, 0xCA);      /* add rdx, rcx */
+        jit_push();
+    } else if (fn == prim_minus) {
+        jit_pop2();
+        JIT(0x48, 0x29, 0xCA);      /* sub rdx, rcx */
+        jit_push();
+    } else if (fn == prim_star) {
+        jit_pop2();
+        JIT(0x48, 0x0F, 0xAF, 0xD1); /* imul rdx, rcx */
+        jit_push();
+    } else if (fn == prim_min || fn == prim_max) {
+        jit_pop2();
+        JIT(0x48, 0x39, 0xCA);      /* cmp rdx, rcx */
+        if (fn == prim_min) JIT(0x48, 0x0F, 0x4D, 0xD1); /* cmovge rdx, rcx */
+        else JIT(0x48, 0x0F, 0x4E, 0xD1);                /* cmovle rdx, rcx */
+        jit_push();
+    } else if (fn == prim_negate) {
+        jit_pop();
+        JIT(0x48, 0xF7, 0xDA);      /* neg rdx */
+        jit_push();
+    } else if (fn == prim_2star) {
+        jit_pop();
+        JIT(0x48, 0x01, 0xD2);      /* add rdx, rdx */
+        jit_push();
+    } else if (fn == prim_2slash) {
+        jit_pop();
+        JIT(0x48, 0x89, 0xD1,       /* mov rcx, rdx */
+            0x48, 0xC1, 0xE9, 0x3F, /* shr rcx, 63 */
+            0x48, 0x01, 0xCA,       /* add rdx, rcx */
+            0x48, 0xD1, 0xFA);      /* sar rdx, 1 */
+        jit_push();
+    } else if (fn == prim_eq || fn == prim_lt || fn == prim_gt) {
+        jit_pop2();
+        JIT(0x48, 0x39, 0xCA);      /* cmp rdx, rcx */
+        jit_push_flag(fn == prim_eq ? 0x94 : fn == prim_lt ? 0x9C : 0x9F);
+    } else if (fn == prim_0eq) {
+        jit_pop();
+        JIT(0x48, 0x85, 0xD2);      /* test rdx, rdx */
+        jit_push_flag(0x94);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/* The word a fused cell stands for; its tail cells are still in place */
+static struct word *jit_unfuse(struct word *w) {
+    for (size_t i = 0; i < sizeof(fusions) / sizeof(fusions[0]); i++) {
+        if (fusions[i].fused == w) return fusions[i].a;
+    }
+    return w;
+}
+
+/* Whether jit_inline() handles fn, without keeping any code */
+static int jit_inline_ok(codefn fn) {
+    size_t len = jit_len;
+    int nfix = jit_nfix;
+    int ok = jit_inline(fn);
+    jit_len = len;
+    jit_nfix = nfix;
+    return ok;
+}
+
+/* Inlinable cells in [i, j): LIT n, values and words jit_inline() handles */
+static void jit_cells(Cell *start, int i, int j) {
+    while (i < j) {
+        struct word *w = jit_unfuse((struct word *)(uintptr_t)start[i]);
+        if (w == w_lit) {
+            JIT(0x48, 0xBA);        /* mov rdx, n */
+            jit_u64((uint64_t)start[i + 1]);
+            jit_push();
+            i += 2;
+        } else if (w->op == OP_VALUE) {
+            JIT(0x48, 0xBA);        /* mov rdx, param */
+            jit_u64((uint64_t)(uintptr_t)w->param);
+            JIT(0x48, 0x8B, 0x12);  /* mov rdx, [rdx] */
+            jit_push();
+            i++;
+        } else {
+            jit_inline(w->code);
+            i++;
+        }
+    }
+}
+
+static void jit_patch32(size_t at, int32_t v) {
+    memcpy(jit_buf + at, &v, 4);
+}
+
+/*
+ * A straight run of inlined words checks the starting depth once. If
+ * no step of the run can under- or overflow, it runs unchecked with a
+ * single sp update; otherwise the fully checked copy runs and fails at
+ * the same word the interpreter would.
+ */
+static void jit_run(Cell *start, int i, int j) {
+    size_t lo_at, hi_at, jl_at, jg_at, jmp_at;
+
+    JIT(0x41, 0x81, 0xFC);          /* cmp r12d, lo */
+    lo_at = jit_len;
+    jit_u32(0);
+    JIT(0x0F, 0x8C);                /* jl checked */
+    jl_at = jit_len;
+    jit_u32(0);
+    JIT(0x41, 0x81, 0xFC);          /* cmp r12d, hi */
+    hi_at = jit_len;
+    jit_u32(0);
+    JIT(0x0F, 0x8F);                /* jg checked */
+    jg_at = jit_len;
+    jit_u32(0);
+
+    jit_unchecked = 1;
+    jit_cur = 0;
+    jit_lo = 0;
+    jit_hi = STACK_SIZE;
+    jit_cells(start, i, j);
+    jit_emit(NULL, 0);
+    jit_unchecked = 0;
+    if (jit_cur) {
+        JIT(0x41, 0x81, 0xC4);      /* add r12d, cur */
+        jit_u32((uint32_t)jit_cur);
+    }
+    JIT(0xE9);                      /* jmp done */
+    jmp_at = jit_len;
+    jit_u32(0);
+
+    jit_patch32(lo_at, jit_lo);
+    jit_patch32(hi_at, jit_hi);
+    jit_patch32(jl_at, (int32_t)(jit_len - (jl_at + 4)));
+    jit_patch32(jg_at, (int32_t)(jit_len - (jg_at + 4)));
+    jit_cells(start, i, j);
+    jit_patch32(jmp_at, (int32_t)(jit_len - (jmp_at + 4)));
+}
+
+/* Loop control sits in rstack[] above the r13d native frames */
+static void jit_rstack(void) {
+    JIT(0x48, 0xB8);                /* mov rax, rstack */
+    jit_u64((uint64_t)(uintptr_t)rstack);
+}
+
+/* Die unless r13d >= n */
+static void jit_need_r(uint8_t n) {
+    JIT(0x41, 0x83, 0xFD);          /* cmp r13d, n */
+    jit_emit(&n, 1);
+    JIT(0x0F, 0x8C);                /* jl return stack underflow */
+    jit_rel32(JIT_RSTACK_UNDERFLOW);
+}
+
+/* (DO)/(?DO): index and limit off the data stack onto rstack */
+static void jit_do(int skip) {
+    jit_pop2();                     /* rcx = index, rdx = limit */
+    if (skip >= 0) {
+        JIT(0x48, 0x39, 0xD1,       /* cmp rcx, rdx */
+            0x0F, 0x84);            /* je past the loop */
+        jit_rel32(skip);
+    }
+    JIT(0x41, 0x81, 0xFD);          /* cmp r13d, RSTACK_SIZE - 2 */
+    jit_u32(RSTACK_SIZE - 2);
+    JIT(0x0F, 0x8F);                /* jg return stack overflow */
+    jit_rel32(JIT_RSTACK_OVERFLOW);
+    jit_rstack();
+    JIT(0x4A, 0x89, 0x14, 0xE8,     /* mov [rax + r13*8], rdx */
+        0x4A, 0x89, 0x4C, 0xE8, 0x08, /* mov [rax + r13*8 + 8], rcx */
+        0x41, 0x83, 0xC5, 0x02);    /* add r13d, 2 */
+}
+
+/* (LOOP)/(+LOOP): step the index, branch back to body or drop the frame */
+static void jit_loop(int plus, int body) {
+    if (plus) {
+        jit_pop();
+        JIT(0x48, 0x89, 0xD1);      /* mov rcx, rdx */
+    }
+    jit_need_r(2);
+    jit_rstack();
+    JIT(0x4A, 0x8B, 0x54, 0xE8, 0xF8); /* mov rdx, [rax + r13*8 - 8] */
+    if (plus) {
+        JIT(0x48, 0x89, 0xD6,       /* mov rsi, rdx */
+            0x4A, 0x2B, 0x74, 0xE8, 0xF0, /* sub rsi, [rax + r13*8 - 16] */
+            0x48, 0x01, 0xCA,       /* add rdx, rcx */
+            0x4A, 0x89, 0x54, 0xE8, 0xF8, /* mov [rax + r13*8 - 8], rdx */
+            0x48, 0x89, 0xF7,       /* mov rdi, rsi */
+            0x48, 0x01, 0xCF,       /* add rdi, rcx */
+            0x48, 0x31, 0xF7,       /* xor rdi, rsi */
+            0x48, 0x31, 0xCE,       /* xor rsi, rcx */
+            0x48, 0x85, 0xF7,       /* test rdi, rsi */
+            0x0F, 0x89);            /* jns body */
+    } else {
+        JIT(0x48, 0xFF, 0xC2,       /* inc rdx */
+            0x4A, 0x89, 0x54, 0xE8, 0xF8, /* mov [rax + r13*8 - 8], rdx */
+            0x4A, 0x3B, 0x54, 0xE8, 0xF0, /* cmp rdx, [rax + r13*8 - 16] */
+            0x0F, 0x85);            /* jne body */
+    }
+    jit_rel32(body);
+    JIT(0x41, 0x83, 0xED, 0x02);    /* sub r13d, 2 */
+}
+
+/* I and J: push the index n loops out */
+static void jit_index(int outer) {
+    jit_need_r(outer ? 4 : 2);
+    jit_rstack();
+    if (outer) JIT(0x4A, 0x8B, 0x54, 0xE8, 0xE8); /* mov rdx, [rax + r13*8 - 24] */
+    else JIT(0x4A, 0x8B, 0x54, 0xE8, 0xF8);       /* mov rdx, [rax + r13*8 - 8] */
+    jit_push();
+}
+
+static void jit_execute(void) {
+    exec_word((struct word *)(uintptr_t)pop());
+}
+
+/* Copies the generated code to jit_base; NULL when out of room */
+static codefn jit_install(void) {
+    size_t size = (jit_len + jit_page - 1) & ~(jit_page - 1);
+    if (jit_used + size > JIT_REGION) return NULL;
+    uint8_t *code = jit_base;
+    if (mprotect(code, size, PROT_READ | PROT_WRITE)) return NULL;
+    memcpy(code, jit_buf, jit_len);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC)) return NULL;
+    jit_used += size;
+    return (codefn)(uintptr_t)code;
+}
+
+/* Translates the thread [start, end) of self; NULL leaves it interpreted */
+static codefn jit_compile(struct word *self, Cell *start, Cell *end) {
+    static const char msg_under[] = "stack underflow";
+    static const char msg_over[] = "stack overflow";
+    static const char msg_rover[] = "return stack overflow";
+    static const char msg_runder[] = "return stack underflow";
+    int ncells = (int)(end - start);
+    size_t stub[4];
+    size_t *label = malloc(((size_t)ncells + 1) * sizeof(*label));
+    char *target = malloc((size_t)ncells + 1);
+    codefn fn = NULL;
+    if (!label || !target) die("out of memory");
+    if (!jit_region) {
+        void *p = mmap(NULL, JIT_REGION, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) goto out;
+        jit_region = p;
+        jit_page = (size_t)sysconf(_SC_PAGESIZE);
+    }
+
+    jit_base = jit_region + jit_used;
+    jit_len = 0;
+    jit_nfix = 0;
+    JIT(0x53,                       /* push rbx */
+        0x41, 0x54,                 /* push r12 */
+        0x41, 0x55,                 /* push r13 */
+        0x48, 0xBB);                /* mov rbx, stack */
+    jit_u64((uint64_t)(uintptr_t)stack);
+    jit_reload_sp();
+    JIT(0xE8);                      /* call body */
+    jit_u32((uint32_t)(JIT_ENTRY - (jit_len + 4)));
+    jit_spill_sp();
+    JIT(0x41, 0x5D,                 /* pop r13 */
+        0x41, 0x5C,                 /* pop r12 */
+        0x5B,                       /* pop rbx */
+        0xC3);                      /* ret */
+    while (jit_len < JIT_ENTRY) JIT(0xCC); /* int3 */
+
+    JIT(0x48, 0x83, 0xEC, 0x08,     /* sub rsp, 8 */
+        0x41, 0x81, 0xFD);          /* cmp r13d, RSTACK_SIZE */
+    jit_u32(RSTACK_SIZE);
+    JIT(0x0F, 0x8D);                /* jge return stack overflow */
+    jit_rel32(JIT_RSTACK_OVERFLOW);
+    JIT(0x41, 0xFF, 0xC5);          /* inc r13d */
+
+    /* Branch targets end straight runs */
+    memset(target, 0, (size_t)ncells + 1);
+    for (int i = 0; i < ncells; i++) {
+        if (!is_word(start[i])) goto out; /* inline data or a NULL cell */
+        struct word *w = jit_unfuse((struct word *)(uintptr_t)start[i]);
+        label[i] = SIZE_MAX;
+        if (has_operand(w)) {
+            if (i + 1 >= ncells) goto out;
+            Cell t = i + 2 + start[i + 1];
+            if (w != w_lit && t >= 0 && t <= ncells) target[t] = 1;
+            label[++i] = SIZE_MAX;
+        }
+    }
+
+    for (int i = 0; i < ncells; i++) {
+        struct word *w = jit_unfuse((struct word *)(uintptr_t)start[i]);
+        label[i] = jit_len;
+
+        int j = i;
+        while (j < ncells && (j == i || !target[j])) {
+            struct word *x = jit_unfuse((struct word *)(uintptr_t)start[j]);
+            if (x == w_lit) j += 2;
+            else if (x->op == OP_VALUE) j++;
+            else if (x->code && jit_inline_ok(x->code)) j++;
+            else break;
+        }
+        if (j > ncells) goto out;
+        if (j > i) {
+            jit_run(start, i, j);
+            i = j - 1;
+            continue;
+        }
+
+        if (has_operand(w)) {
+            Cell arg = start[++i];
+            Cell dest = i + 1 + arg;
+            if (dest < 0 || dest > ncells) goto out;
+            if (w->op == OP_0BRANCH) {
+                jit_pop();
+                JIT(0x48, 0x85, 0xD2, /* test rdx, rdx */
+                    0x0F, 0x84);      /* jz dest */
+                jit_rel32((int)dest);
+            } else if (w->op == OP_BRANCH) {
+                JIT(0xE9);            /* jmp dest */
+                jit_rel32((int)dest);
+            } else if (w->op == OP_QDO) {
+                jit_do((int)dest);
+            } else {
+                jit_loop(w->op == OP_PLUS_LOOP, (int)dest);
+            }
+        } else if (w->op == OP_DO) {
+            jit_do(-1);
+        } else if (w->op == OP_I || w->op == OP_J) {
+            jit_index(w->op == OP_J);
+        } else if (w->op == OP_UNLOOP) {
+            jit_need_r(2);
+            JIT(0x41, 0x83, 0xED, 0x02); /* sub r13d, 2 */
+        } else if (w->op == OP_SET_DOES) {
+            goto out; /* needs the thread after it */
+        } else if (w == w_exit) {
+            jit_epilogue();
+        } else if (w == self) {
+            jit_call(jit_base);
+        } else if (w->op == OP_EXECUTE) {
+            jit_call((const void *)(uintptr_t)jit_execute);
+        } else if (w->code) {
+            if (!jit_inline(w->code)) jit_call((const void *)(uintptr_t)w->code);
+        } else {
+            JIT(0x48, 0xBF);          /* mov rdi, w */
+            jit_u64((uint64_t)(uintptr_t)w);
+            jit_call((const void *)(uintptr_t)exec_word);
+        }
+    }
+    label[ncells] = jit_len;
+    jit_epilogue();
+
+    stub[0] = jit_len;
+    jit_call_die(msg_under);
+    stub[1] = jit_len;
+    jit_call_die(msg_over);
+    stub[2] = jit_len;
+    jit_call_die(msg_rover);
+    stub[3] = jit_len;
+    jit_call_die(msg_runder);
+
+    for (int k = 0; k < jit_nfix; k++) {
+        int t = jit_fix[k].target;
+        size_t dest = t >= 0 ? label[t] : stub[-t - 1];
+        if (dest == SIZE_MAX) goto out; /* branch into an operand */
+        int32_t rel = (int32_t)((int64_t)dest - (int64_t)(jit_fix[k].at + 4));
+        memcpy(jit_buf + jit_fix[k].at, &rel, 4);
+    }
+    fn = jit_install();
+out:
+    free(label);
+    free(target);
+    return fn;
+}
+#undef JIT
+#endif
+
+#ifndef FORTH_NO_FUSION
+/* Only cells thread_code() marks are words; the rest may be inline data */
+static void fuse_thread(Cell *p, int n, const char *code) {
+    for (int i = 0; i < n; i++) {
+        if (!code[i]) continue;
+        struct word *a = (struct word *)(uintptr_t)p[i];
+        int next = has_operand(a) ? i + 2 : i + 1;
+        if (next >= n || !code[next]) continue;
+        struct word *b = (struct word *)(uintptr_t)p[next];
+        for (size_t k = 0; k < sizeof(fusions) / sizeof(fusions[0]); k++) {
+            if (fusions[k].a == a && fusions[k].b == b) {
+                p[i] = (Cell)(uintptr_t)fusions[k].fused;
+                break;
+            }
+        }
+    }
+}
+#endif
+
 static void prim_semicolon(void) {
     if (!w_exit) die("EXIT missing");
+    if (loop_depth) die("DO without LOOP");
     dict_emit((Cell)(uintptr_t)w_exit);
+    if (latest && latest->param) {
+        int n = (int)(&dict[here] - latest->param);
+        char *code = thread_code(latest->param, n);
+#ifndef FORTH_NO_FUSION
+        fuse_thread(latest->param, n, code);
+#endif
+        free(code);
+    }
+#ifdef FORTH_JIT
+    if (latest && latest->op == OP_COLON) {
+        codefn fn = jit_compile(latest, latest->param, &dict[here]);
+        if (fn) {
+            latest->code = fn;
+            latest->op = OP_PRIM;
+        }
+    }
+#endif
+    if (latest) latest->flags &= (uint8_t)~F_HIDDEN;
     state = 0;
 }
 
@@ -432,7 +2063,7 @@ static void prim_dot_quote(void) {
     s[len] = '\0';
 
     if (!state) {
-        write(1, s, (size_t)len);
+        out_write(s, (size_t)len);
         return;
     }
 
@@ -475,60 +2106,409 @@ static void prim_bracket_then(void) {
     /* Marker only */
 }
 
+/* =============================
+ * Forgetting
+ * ============================= */
+
+/*
+ * FORGET name drops name and every later word, giving back their
+ * dictionary cells, strings and (under FORTH_JIT) native code. A word
+ * made by MARKER name forgets itself and everything after it when run,
+ * so a file can start with `MARKER -file` and be reloaded after
+ * running -file. Built-in words can't be forgotten.
+ */
+static int num_builtins = 0; /* words made by init_words() */
+
+static void forget_from(int n) {
+    if (n < num_builtins || n >= num_words) die("cannot forget that");
+#ifdef FORTH_JIT
+    size_t used = jit_used;
+#endif
+    for (int i = num_words - 1; i >= n; i--) {
+        struct word *w = &words[i];
+        /* Newest first, so each is still the head of its bucket */
+        buckets[w->hash & (HASH_BUCKETS - 1)] = w->hash_link;
+#ifdef FORTH_JIT
+        const uint8_t *code = (const uint8_t *)(uintptr_t)w->code;
+        if (code >= jit_region && code < jit_region + JIT_REGION &&
+            (size_t)(code - jit_region) < used)
+            used = (size_t)(code - jit_region);
+#endif
+#ifndef FORTH_PROFILE /* the profile report still needs the name */
+        free(w->name);
+#endif
+    }
+#ifdef FORTH_JIT
+    jit_used = used;
+#endif
+    latest = words[n].link;
+    here = words[n].here_mark;
+    string_here = words[n].heap_mark;
+    num_words = n;
+}
+
+static void prim_forget(void) {
+    if (!read_word(word_buf, WORD_BUF_SIZE)) die("missing name");
+    struct word *w = find_word(word_buf);
+    if (!w) die("unknown word");
+    forget_from((int)(w - words));
+}
+
+/* ( n -- ) run by marker words: forget words[n] and later */
+static void prim_paren_forget(void) {
+    Cell n = pop();
+    if (n < 0 || n >= num_words) die("cannot forget that");
+    forget_from((int)n);
+}
+
+static void prim_marker(void) {
+    if (!read_word(word_buf, WORD_BUF_SIZE)) die("missing name");
+    int n = num_words;
+    struct word *w = new_word(word_buf, NULL, 0);
+    w->op = OP_COLON;
+    w->param = &dict[here];
+    dict_emit((Cell)(uintptr_t)w_lit);
+    dict_emit((Cell)n);
+    dict_emit((Cell)(uintptr_t)w_forget);
+    dict_emit((Cell)(uintptr_t)w_exit);
+}
+
+/* =============================
+ * Images
+ * ============================= */
+
+/*
+ * SAVE-IMAGE name writes the word headers, dictionary and string heap
+ * to a file that `--image name` loads instead of re-reading the source.
+ * Links and params are stored as indexes and code as offsets from a
+ * primitive, so an image survives ASLR. Dictionary cells are plain data
+ * to the image: a cell that pointed into dict, words, string_heap, state
+ * or base when saved is taken to be a pointer and moved with its target.
+ * The built-in words must match the loading binary, user words may only
+ * use built-in code, and an FNV-1a checksum covers everything after the
+ * header.
+ */
+enum { IMAGE_VERSION = 3 };
+
+static const char image_magic[8] = "S2IMAGE";
+
+struct image_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t cell_size;
+    uint64_t checksum;
+    uint64_t dict, words, heap, state, base; /* addresses when saved */
+    int32_t here, string_here, num_words, builtins, latest, base_value;
+    uint32_t names_size, pad;
+};
+
+struct image_word {
+    int32_t link;  /* index + 1, 0 for none */
+    int32_t param; /* dict index, -1 for none */
+    int64_t code;  /* offset from prim_drop, if has_code */
+    uint32_t name; /* offset into the names blob */
+    uint8_t len, flags, op, has_code;
+    int32_t here_mark, heap_mark;
+    int32_t does; /* dict index, -1 for none */
+    int32_t pad;
+};
+
+static uint64_t fnv64(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211u;
+    }
+    return h;
+}
+
+static void prim_save_image(void) {
+    struct image_header h;
+    struct image_word *iw = calloc((size_t)num_words + 1, sizeof(*iw));
+    uint32_t names_size = 0;
+
+    if (!read_word(word_buf, WORD_BUF_SIZE)) die("missing name");
+    if (!iw) die("out of memory");
+    for (int i = 0; i < num_words; i++) names_size += words[i].len + 1u;
+    char *names = malloc(names_size + 1);
+    if (!names) die("out of memory");
+
+    uint32_t at = 0;
+    for (int i = 0; i < num_words; i++) {
+        struct word *w = &words[i];
+        codefn code = w->code;
+        iw[i].link = w->link ? (int32_t)(w->link - words) + 1 : 0;
+        iw[i].param = w->param ? (int32_t)(w->param - dict) : -1;
+        iw[i].name = at;
+        iw[i].len = w->len;
+        iw[i].flags = w->flags;
+        iw[i].op = w->op;
+        iw[i].here_mark = w->here_mark;
+        iw[i].heap_mark = w->heap_mark;
+        iw[i].does = w->does ? (int32_t)(w->does - dict) : -1;
+#ifdef FORTH_JIT
+        /* Native code is not saved; the word runs threaded after loading */
+        if (code && (const uint8_t *)(uintptr_t)code >= jit_region &&
+            (const uint8_t *)(uintptr_t)code < jit_region + JIT_REGION) {
+            code = NULL;
+            iw[i].op = OP_COLON;
+        }
+#endif
+        if (code) {
+            iw[i].has_code = 1;
+            iw[i].code = (int64_t)((uintptr_t)code - (uintptr_t)prim_drop);
+        }
+        memcpy(names + at, w->name, (size_t)w->len + 1);
+        at += w->len + 1u;
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, image_magic, sizeof(h.magic));
+    h.version = IMAGE_VERSION;
+    h.cell_size = sizeof(Cell);
+    h.dict = (uintptr_t)dict;
+    h.words = (uintptr_t)words;
+    h.heap = (uintptr_t)string_heap;
+    h.state = (uintptr_t)&state;
+    h.base = (uintptr_t)&base;
+    h.here = here;
+    h.string_here = string_here;
+    h.num_words = num_words;
+    h.builtins = num_builtins;
+    h.latest = latest ? (int32_t)(latest - words) : -1;
+    h.base_value = base;
+    h.names_size = names_size;
+
+    uint64_t sum = 14695981039346656037u;
+    sum = fnv64(sum, iw, (size_t)num_words * sizeof(*iw));
+    sum = fnv64(sum, names, names_size);
+    sum = fnv64(sum, dict, (size_t)here * sizeof(Cell));
+    sum = fnv64(sum, string_heap, (size_t)string_here);
+    h.checksum = sum;
+
+    FILE *f = fopen(word_buf, "wb");
+    if (!f) die("cannot write image");
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(iw, sizeof(*iw), (size_t)num_words, f);
+    fwrite(names, 1, names_size, f);
+    fwrite(dict, sizeof(Cell), (size_t)here, f);
+    fwrite(string_heap, 1, (size_t)string_here, f);
+    int bad = ferror(f);
+    if (fclose(f) || bad) die("cannot write image");
+    free(names);
+    free(iw);
+}
+
+/* A saved cell value, moved if it pointed into one of our arrays */
+static Cell image_reloc(const struct image_header *h, Cell v) {
+    const struct { uint64_t old; uintptr_t now; size_t size; } regions[] = {
+        { h->dict, (uintptr_t)dict, sizeof(dict) },
+        { h->words, (uintptr_t)words, sizeof(words) },
+        { h->heap, (uintptr_t)string_heap, sizeof(string_heap) },
+        { h->state, (uintptr_t)&state, sizeof(state) },
+        { h->base, (uintptr_t)&base, sizeof(base) },
+    };
+    for (size_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+        uint64_t off = (uint64_t)v - regions[i].old;
+        if (off < regions[i].size) return (Cell)(regions[i].now + off);
+    }
+    return v;
+}
+
+/* Code a user word may have: that of some built-in */
+static int builtin_code(codefn fn) {
+    for (int i = 0; i < num_builtins; i++) {
+        if (words[i].code == fn) return 1;
+    }
+    return 0;
+}
+
+/* Whether a loaded user word has what its op needs */
+static int image_word_ok(const struct word *w, int cells) {
+    int data = w->param && w->param < &dict[cells];
+    switch (w->op) {
+    case OP_PRIM: return w->code && !w->does;
+    case OP_COLON: return !w->code && !w->does;
+    case OP_CONSTANT:
+    case OP_VALUE: return !w->code && !w->does && data;
+    case OP_CREATE: return !w->code && !w->does && w->param;
+    case OP_DOES: return !w->code && w->does && w->param;
+    default: return 0;
+    }
+}
+
+static void load_image(const char *path) {
+    struct image_header h;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) die("cannot open image");
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(h)) die("bad image");
+    size_t size = (size_t)st.st_size;
+    const uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) die("cannot map image");
+
+    memcpy(&h, map, sizeof(h));
+    if (memcmp(h.magic, image_magic, sizeof(h.magic)) || h.version != IMAGE_VERSION ||
+        h.cell_size != sizeof(Cell))
+        die("bad image");
+    if (h.builtins != num_builtins || h.num_words < h.builtins || h.num_words > MAX_WORDS ||
+        h.here < 0 || h.here > DICT_CELLS || h.string_here < 0 ||
+        h.string_here > STRING_HEAP_SIZE || h.latest < -1 || h.latest >= h.num_words)
+        die("bad image");
+
+    if (sizeof(h) + (size_t)h.num_words * sizeof(struct image_word) + h.names_size +
+        (size_t)h.here * sizeof(Cell) + (size_t)h.string_here != size)
+        die("bad image");
+    const struct image_word *iw = (const void *)(map + sizeof(h));
+    const char *names = (const char *)(iw + h.num_words);
+    const uint8_t *cells = (const uint8_t *)names + h.names_size;
+    const uint8_t *heap = cells + (size_t)h.here * sizeof(Cell);
+    if (fnv64(14695981039346656037u, iw, size - sizeof(h)) != h.checksum)
+        die("image checksum mismatch");
+
+    for (int i = 0; i < h.num_words; i++) {
+        const struct image_word *r = &iw[i];
+        struct word *w = &words[i];
+        if (r->name + (uint64_t)r->len >= h.names_size || names[r->name + r->len] ||
+            r->link > i || r->param < -1 || r->param > h.here || r->here_mark < 0 ||
+            r->here_mark > h.here || r->heap_mark < 0 || r->heap_mark > h.string_here ||
+            r->does < -1 || r->does >= h.here)
+            die("bad image");
+        if (i < h.builtins) {
+            if (r->len != w->len || memcmp(names + r->name, w->name, r->len))
+                die("image built by a different forth");
+            w->flags = r->flags;
+            continue;
+        }
+        memset(w, 0, sizeof(*w));
+        w->name = strdup(names + r->name);
+        w->len = r->len;
+        w->hash = hash_name(w->name, w->len);
+        w->flags = r->flags;
+        w->op = r->op;
+        w->link = r->link ? &words[r->link - 1] : NULL;
+        w->param = r->param >= 0 ? &dict[r->param] : NULL;
+        w->here_mark = r->here_mark;
+        w->heap_mark = r->heap_mark;
+        w->does = r->does >= 0 ? &dict[r->does] : NULL;
+        if (r->has_code) {
+            w->code = (codefn)((uintptr_t)prim_drop + (uintptr_t)r->code);
+            if (!builtin_code(w->code)) die("bad image");
+        }
+        if (!image_word_ok(w, h.here)) die("bad image");
+    }
+
+    num_words = h.num_words;
+    latest = h.latest >= 0 ? &words[h.latest] : NULL;
+    here = h.here;
+    string_here = h.string_here;
+    base = h.base_value;
+    for (int i = 0; i < here; i++) {
+        Cell v;
+        memcpy(&v, cells + (size_t)i * sizeof(Cell), sizeof(Cell));
+        dict[i] = image_reloc(&h, v);
+    }
+    memcpy(string_heap, heap, (size_t)string_here);
+
+    memset(buckets, 0, sizeof(buckets));
+    for (int i = 0; i < num_words; i++) {
+        struct word **bucket = &buckets[words[i].hash & (HASH_BUCKETS - 1)];
+        words[i].hash_link = *bucket;
+        *bucket = &words[i];
+    }
+    munmap((void *)(uintptr_t)map, size);
+}
+
 /* =============================
  * Word registration
  * ============================= */
 
-static struct word *add_prim(const char *name, codefn fn, int immediate) {
+static struct word *new_word(const char *name, codefn fn, uint8_t flags) {
     if (num_words >= MAX_WORDS) die("too many words");
     struct word *w = &words[num_words++];
+    char key[WORD_BUF_SIZE];
+    int len = normalize_name(key, name);
+
     memset(w, 0, sizeof(*w));
-    w->name = strdup(name);
-    w->link = latest;
-    w->flags = (uint8_t)(immediate ? F_IMMED : 0);
+    w->name = strdup(key);
+    w->len = (uint8_t)len;
+    w->hash = hash_name(key, len);
+    w->flags = flags;
     w->code = fn;
     w->param = NULL;
+    w->here_mark = here;
+    w->heap_mark = string_here;
+    w->link = latest;
     latest = w;
+
+    struct word **bucket = &buckets[w->hash & (HASH_BUCKETS - 1)];
+    w->hash_link = *bucket;
+    *bucket = w;
+    return w;
+}
+
+static struct word *add_prim(const char *name, codefn fn, int immediate) {
+    return new_word(name, fn, (uint8_t)(immediate ? F_IMMED : 0));
+}
+
+/* Words run directly by the inner interpreter */
+static struct word *add_op(const char *name, uint8_t op) {
+    struct word *w = new_word(name, NULL, 0);
+    w->op = op;
+    return w;
+}
+
+/* A C primitive that FORTH_FAST builds run inline as op instead */
+static struct word *add_fast(const char *name, codefn fn, uint8_t op) {
+    struct word *w = add_prim(name, fn, 0);
+#ifdef FORTH_FAST
+    w->op = op;
+#else
+    (void)op;
+#endif
     return w;
 }
 
 static void init_words(void) {
-    add_prim("DROP", prim_drop, 0);
-    add_prim("DUP", prim_dup, 0);
-    add_prim("?DUP", prim_qdup, 0);
-    add_prim("SWAP", prim_swap, 0);
-    add_prim("OVER", prim_over, 0);
-    add_prim("ROT", prim_rot, 0);
-    add_prim("TUCK", prim_tuck, 0);
-    add_prim("NIP", prim_nip, 0);
-    add_prim("2DUP", prim_2dup, 0);
-    add_prim("2DROP", prim_2drop, 0);
+    add_fast("DROP", prim_drop, OP_DROP);
+    add_fast("DUP", prim_dup, OP_DUP);
+    add_fast("?DUP", prim_qdup, OP_QDUP);
+    add_fast("SWAP", prim_swap, OP_SWAP);
+    add_fast("OVER", prim_over, OP_OVER);
+    add_fast("ROT", prim_rot, OP_ROT);
+    add_fast("TUCK", prim_tuck, OP_TUCK);
+    add_fast("NIP", prim_nip, OP_NIP);
+    add_fast("2DUP", prim_2dup, OP_2DUP);
+    add_fast("2DROP", prim_2drop, OP_2DROP);
     add_prim("DEPTH", prim_depth, 0);
     add_prim("PICK", prim_pick, 0);
 
-    add_prim("+", prim_plus, 0);
-    add_prim("-", prim_minus, 0);
-    add_prim("*", prim_star, 0);
+    add_fast("+", prim_plus, OP_PLUS);
+    add_fast("-", prim_minus, OP_MINUS);
+    add_fast("*", prim_star, OP_STAR);
     add_prim("/", prim_slash, 0);
     add_prim("MOD", prim_mod, 0);
     add_prim("/MOD", prim_divmod, 0);
-    add_prim("NEGATE", prim_negate, 0);
-    add_prim("2*", prim_2star, 0);
-    add_prim("2/", prim_2slash, 0);
+    add_fast("NEGATE", prim_negate, OP_NEGATE);
+    add_fast("2*", prim_2star, OP_2STAR);
+    add_fast("2/", prim_2slash, OP_2SLASH);
     add_prim("CELLS", prim_cells, 0);
-    add_prim("MIN", prim_min, 0);
-    add_prim("MAX", prim_max, 0);
+    add_fast("MIN", prim_min, OP_MIN);
+    add_fast("MAX", prim_max, OP_MAX);
 
-    add_prim("<", prim_lt, 0);
-    add_prim(">", prim_gt, 0);
-    add_prim("=", prim_eq, 0);
-    add_prim("0=", prim_0eq, 0);
+    add_fast("<", prim_lt, OP_LT);
+    add_fast(">", prim_gt, OP_GT);
+    add_fast("=", prim_eq, OP_EQ);
+    add_fast("0=", prim_0eq, OP_0EQ);
 
     add_prim("EMIT", prim_emit, 0);
     add_prim("SPACE", prim_space, 0);
     add_prim("CR", prim_cr, 0);
     add_prim("TYPE", prim_type, 0);
     add_prim(".", prim_dot, 0);
+    add_prim("FLUSH", prim_flush, 0);
+    add_prim("SAVE-IMAGE", prim_save_image, 0);
 
     add_prim("BYE", prim_bye, 0);
 
@@ -536,14 +2516,24 @@ static void init_words(void) {
     add_prim("ALLOT", prim_allot, 0);
     add_prim(",", prim_comma, 0);
     add_prim("C,", prim_ccomma, 0);
+    add_prim("@", prim_fetch, 0);
+    w_store = add_prim("!", prim_store, 0);
+    add_prim("CMOVE", prim_cmove, 0);
+    add_prim("CMOVE>", prim_cmove_up, 0);
+    add_prim("MOVE", prim_move, 0);
+    add_prim("FILL", prim_fill, 0);
+    add_prim("COMPARE", prim_compare, 0);
+    add_prim("SEARCH", prim_search, 0);
     add_prim("STATE", prim_state, 0);
     add_prim("BASE", prim_base, 0);
 
     add_prim("[", prim_lbracket, 1);
     add_prim("]", prim_rbracket, 0);
     add_prim("IMMEDIATE", prim_immediate, 1);
+    add_prim("HIDDEN", prim_hidden, 0);
+    add_prim("RECURSE", prim_recurse, 1);
     add_prim("'", prim_tick, 0);
-    add_prim("EXECUTE", prim_execute, 0);
+    add_op("EXECUTE", OP_EXECUTE);
 
     add_prim("\\", prim_backslash, 1);
     add_prim("(", prim_paren, 1);
@@ -556,12 +2546,45 @@ static void init_words(void) {
     add_prim("[THEN]", prim_bracket_then, 1);
 
     /* Core control for colon words */
-    w_lit = add_prim("LIT", prim_lit, 0);
-    w_exit = add_prim("EXIT", prim_exit, 0);
-    add_prim("BRANCH", prim_branch, 0);
-    add_prim("0BRANCH", prim_0branch, 0);
+    w_lit = add_op("LIT", OP_LIT);
+    w_exit = add_op("EXIT", OP_EXIT);
+    w_branch = add_op("BRANCH", OP_BRANCH);
+    w_0branch = add_op("0BRANCH", OP_0BRANCH);
     add_prim(":", prim_colon, 0);
     add_prim(";", prim_semicolon, 1);
+
+    w_do = add_op("(DO)", OP_DO);
+    w_qdo = add_op("(?DO)", OP_QDO);
+    w_loop = add_op("(LOOP)", OP_LOOP);
+    w_plus_loop = add_op("(+LOOP)", OP_PLUS_LOOP);
+    w_unloop = add_op("UNLOOP", OP_UNLOOP);
+    add_op("I", OP_I);
+    add_op("J", OP_J);
+    add_prim("DO", prim_do, 1);
+    add_prim("?DO", prim_qdo, 1);
+    add_prim("LOOP", prim_loop, 1);
+    add_prim("+LOOP", prim_plus_loop, 1);
+    add_prim("LEAVE", prim_leave, 1);
+
+    add_prim("CONSTANT", prim_constant, 0);
+    add_prim("VALUE", prim_value, 0);
+    add_prim("VARIABLE", prim_variable, 0);
+    add_prim("CREATE", prim_create, 0);
+    add_prim("TO", prim_to, 1);
+    add_prim("DOES>", prim_does, 1);
+    w_set_does = add_op("(DOES>)", OP_SET_DOES);
+
+    add_prim("FORGET", prim_forget, 0);
+    add_prim("MARKER", prim_marker, 0);
+    w_forget = add_prim("(FORGET)", prim_paren_forget, 0);
+    w_null = add_prim("(NULL)", prim_null, 0);
+
+    for (size_t i = 0; i < sizeof(fusions) / sizeof(fusions[0]); i++) {
+        fusions[i].a = find_word(fusions[i].first);
+        fusions[i].b = find_word(fusions[i].second);
+        fusions[i].fused = add_op(fusions[i].name, fusions[i].op);
+    }
+    num_builtins = num_words;
 }
 
 static void interpret(void) {
@@ -572,7 +2595,7 @@ static void interpret(void) {
             if (!state || (w->flags & F_IMMED)) {
                 exec_word(w);
             } else {
-                dict_emit((Cell)(uintptr_t)w);
+                compile_word(w);
             }
             continue;
         }
@@ -590,13 +2613,32 @@ static void interpret(void) {
     }
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    const char *image = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) image = argv[++i];
+#ifdef FORTH_PROFILE
+        else if (strcmp(argv[i], "--folded") == 0 && i + 1 < argc) prof_folded = argv[++i];
+        else die("usage: forth [--image file] [--folded file]");
+#else
+        else die("usage: forth [--image file]");
+#endif
+    }
+
     if (isatty(0)) {
         printf("sectorc Stage 2 Forth\n");
         printf("Type 'BYE' to exit\n\n");
     }
 
+#ifdef FORTH_PROFILE
+    prof_init();
+#endif
     init_words();
+    if (image) load_image(image);
     interpret();
+    out_flush();
+#ifdef FORTH_PROFILE
+    profile_report();
+#endif
     return 0;
 }
@@ -17,16 +17,44 @@
  *   - goto/labels
  *   - Self-hosting capability
  *
+ * Code generation drops unreachable statements, and in whole-program
+ * mode (several inputs, or --whole-program) every function and global
+ * not reachable from main.
+ *
+ * All compiler state hangs off a context (see sectorc.h), so the compiler
+ * also builds as a reentrant library with -DSECTORC_LIBRARY.
+ *
  * Target: ~80KB of source code
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdarg.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sectorc.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /* ============================================
  * Constants and Limits
@@ -35,14 +63,24 @@
 #define MAX_TOKEN       512
 #define MAX_IDENT       128
 #define MAX_SYMBOLS     4096
-#define MAX_TYPES       512
-#define MAX_STRINGS     1024
+#define TYPE_BLOCK      256
 #define MAX_DEFINES     512
 #define MAX_LOCALS      256
 #define MAX_MEMBERS     64
 #define MAX_CASES       256
 #define MAX_INCLUDE     16
 #define MAX_MACRO_ARGS  16
+#define MAX_INPUTS      256
+#define MAX_JOBS        64
+#define MAX_TEMP_FILES  64
+#define MAX_PATH        1024
+
+/* Part of every compile cache key. The Makefile passes a hash of the
+ * sources; other builds fall back to when they were built. */
+#ifndef SECTORC_BUILD
+#define SECTORC_BUILD __DATE__ " " __TIME__
+#endif
+#define SECTORC_VERSION "stage5-" SECTORC_BUILD
 
 /* Token types */
 enum {
@@ -102,13 +140,21 @@ struct type {
     int kind;
     int size;
     int align;
-    struct type *base;      /* For pointers, arrays */
-    int array_size;
+    struct type *base;      /* For pointers, arrays; return type of functions */
+    int array_size;         /* Parameter count of functions, -1 if unprototyped */
+    struct type **params;   /* For functions */
     struct member *members; /* For struct/union */
     int num_members;
     char name[MAX_IDENT];   /* For struct/union/enum tags */
 };
 
+/* Types live in fixed blocks so pointers to them stay valid */
+struct type_block {
+    struct type_block *next;
+    int used;
+    struct type types[TYPE_BLOCK];
+};
+
 struct member {
     char name[MAX_IDENT];
     struct type *type;
@@ -122,6 +168,7 @@ struct symbol {
     struct type *type;
     int offset;             /* Stack offset or enum value */
     int defined;
+    const char *asm_name;   /* Statics in multi-file builds; NULL = name */
 };
 
 struct macro {
@@ -133,76 +180,250 @@ struct macro {
 };
 
 /* ============================================
- * Global State
+ * Pipelined Lexing and Output Units
+ * ============================================ */
+
+#define RING_SIZE   4096        /* Power of two */
+#define STR_CHUNK   65536
+
+enum { LEX_TOKEN, LEX_WARN, LEX_ERROR };
+
+struct lex_slot {
+    int kind;
+    int token;
+    long val;
+    const char *str;            /* token_str, if this token rewrote it */
+    const char *name;           /* Position for diagnostics */
+    int line;
+};
+
+struct str_chunk {
+    struct str_chunk *next;
+    size_t used;
+    char text[STR_CHUNK];
+};
+
+/* Output units: every function, global and string is buffered separately
+ * so that whole-program mode can drop the ones main never reaches. */
+struct unit {
+    char name[MAX_IDENT];
+    const char *section;    /* Switched to before text; NULL = self-contained */
+    char *text;
+    int live;
+};
+
+struct unit_ref {
+    int from;               /* Referencing unit */
+    char name[MAX_IDENT];   /* Referenced symbol */
+};
+
+/* A header kept in memory between compilations, checked against stat() */
+struct source {
+    char *path;
+    char *text;
+    long len;
+    time_t mtime;
+    off_t size;
+    ino_t ino;
+};
+
+struct init_item {
+    int offset;
+    int size;
+    long val;
+    char *sym;
+    int seq;                /* Later designators override earlier ones */
+};
+
+/* ============================================
+ * Compiler State
  * ============================================ */
 
-/* Lexer state */
-static FILE *input_files[MAX_INCLUDE];
-static const char *input_names[MAX_INCLUDE];
-static int input_lines[MAX_INCLUDE];
-static int input_depth = 0;
-static int ch;
-static int token;
-static long token_val;
-static char token_str[MAX_TOKEN];
-
-/* Output */
-static FILE *output_file;
-
-/* Types */
-static struct type types[MAX_TYPES];
-static int num_types = 0;
-static struct type *type_void, *type_char, *type_int, *type_long;
-static struct type *type_bool;  /* C99 _Bool */
-
-/* Symbols */
-static struct symbol symbols[MAX_SYMBOLS];
-static int num_symbols = 0;
-static struct symbol locals[MAX_LOCALS];
-static int num_locals = 0;
-static int local_offset = 0;
-static int current_frame_size = 0;
-
-/* Strings */
-static char *strings[MAX_STRINGS];
-static int num_strings = 0;
-
-/* Macros */
-static struct macro macros[MAX_DEFINES];
-static int num_macros = 0;
-
-/* Labels for goto (reserved for future use) */
-static int num_labels = 0;
-
-/* Code generation */
-static int label_count = 0;
-static int break_label = -1;
-static int continue_label = -1;
-static int switch_default = -1;
+/*
+ * Everything a compilation touches lives in a struct sectorc, so one
+ * process can run several compilations on different threads. cc is the
+ * context the current thread compiles with; per-compilation state is in
+ * cc->st. Helper threads (--pipeline, -j) share their parent's context.
+ */
+struct compile_state {
+    /* Lexer state */
+    char *input_bufs[MAX_INCLUDE];  /* Whole file, read up front */
+    long input_pos[MAX_INCLUDE];
+    long input_len[MAX_INCLUDE];
+    const char *input_names[MAX_INCLUDE];
+    int input_lines[MAX_INCLUDE];
+    int input_depth;
+    int ch;
+    int lex_wrote_str;              /* token_str was rewritten by this token */
+    int prelexing;                  /* Hashing tokens for the cache: no output */
+    int num_warnings;
+
+    /* Output */
+    FILE *output_file;
+
+    /* Types */
+    struct type_block *type_blocks;
+    int num_types;
+    int num_type_blocks;
+    struct type **derived_index;    /* Interned pointer/array/function types */
+    int derived_cap;
+    int num_derived;
+    int derived_hits;
+    struct type *type_void, *type_char, *type_short, *type_int, *type_long;
+    struct type *type_bool;         /* C99 _Bool */
+
+    /* Symbols */
+    struct symbol symbols[MAX_SYMBOLS];
+    int num_symbols;
+    int num_files, file_index;      /* Input files; static names get .file_index */
+    struct symbol locals[MAX_LOCALS];
+    int num_locals;
+    int local_offset;
+    int current_frame_size;
+
+    /* Strings: interned, one entry per distinct literal */
+    char **strings;
+    int num_strings;
+    int string_cap;
+    int *string_index;              /* Open-addressed hash of strings[] */
+    int string_index_cap;
+
+    /* Macros */
+    struct macro macros[MAX_DEFINES];
+    int num_macros;
+
+    /* Labels for goto (reserved for future use) */
+    int num_labels;
+
+    /* Code generation */
+    int label_count;
+    int *label_refs;                /* Live branches targeting each label */
+    char *label_reached;            /* Label reached by a folded branch */
+    int label_cap;
+    int reachable;                  /* Current point can be executed */
+    int pending_imm;                /* x0 = pending_val not yet emitted */
+    long pending_val;
+    int pending_jump;               /* Deferred "b L<n>" */
+    int break_label;
+    int continue_label;
+    int switch_default;
+
+    /* Static initializers */
+    struct init_item *init_items;
+    int num_init_items;
+    int init_item_cap;
+    int num_templates;
+
+    /* Output units */
+    struct unit *units;
+    int num_units;
+    int unit_cap;
+    struct unit_ref *unit_refs;
+    int num_unit_refs;
+    int unit_ref_cap;
+    int current_unit;
+    FILE *unit_saved_output;
+    FILE *temp_files[MAX_TEMP_FILES];   /* Open capture streams */
+    int num_temp_files;
+    _Atomic int next_job;           /* Next unit for an optimize worker */
+
+    /* Pipelined lexing: diagnostics use the position recorded with the token */
+    struct lex_slot ring[RING_SIZE];
+    _Atomic size_t ring_head;       /* Next slot the lexer fills */
+    _Atomic size_t ring_tail;       /* Next slot the parser reads */
+    _Atomic int ring_abort;         /* Parser bailed out; lexer should stop */
+    struct str_chunk *str_chunks;
+    int ring_eof;
+    int lexer_running;
+    pthread_t lexer_thread;
+    const char *tok_name;
+    int tok_line;
+};
+
+struct sectorc {
+    /* Options, kept across compilations */
+    int whole_program;
+    int show_stats;
+    int pipeline;
+    int use_simd;
+    int jobs;
+    int peephole;
+
+    /* Kept warm across compilations */
+    struct source *sources;         /* Header cache, when cache_sources */
+    int num_sources;
+    int source_cap;
+    int cache_sources;
+    long source_hits, source_misses;
+    struct type_block *spare_types; /* Type blocks to reuse */
+    FILE *diag;                     /* Diagnostics; NULL = stderr */
+    char cache_dir[MAX_PATH];       /* Compile cache; "" = off */
+    long cache_limit;               /* Bytes kept before evicting */
+
+    /* Current compilation */
+    sectorc_sink out;
+    void *user;
+    int bail_set;                   /* error() longjmps instead of exiting */
+    jmp_buf bail;
+    char error[1024];               /* First error of the last compilation */
+    struct compile_state st;
+};
+
+static _Thread_local struct sectorc *cc;
+
+/* Per thread: with --pipeline the lexer thread has its own copy */
+static _Thread_local int token;
+static _Thread_local long token_val;
+static _Thread_local char token_str[MAX_TOKEN];
+static _Thread_local int in_lexer;
+
+static void lex_message(char *msg, int fatal);
 
 /* ============================================
  * Error Handling
  * ============================================ */
 
+static FILE *diag_out(void) {
+    return cc->diag ? cc->diag : stderr;
+}
+
+static void report(const char *kind, int fatal, const char *fmt, va_list ap) {
+    char msg[1024];
+    const char *name = cc->st.tok_name;
+    int line = cc->st.tok_line;
+    if (!cc->pipeline || in_lexer) {
+        name = cc->st.input_names[cc->st.input_depth];
+        line = cc->st.input_lines[cc->st.input_depth];
+    }
+    if (cc->st.prelexing) return;          /* The real pass reports it */
+    int n = snprintf(msg, sizeof(msg), "%s:%d: %s: ", name, line, kind);
+    vsnprintf(msg + n, sizeof(msg) - n, fmt, ap);
+    /* The lexer thread hands its messages to the parser, in token order */
+    if (in_lexer) { lex_message(strdup(msg), fatal); return; }
+    if (!fatal) cc->st.num_warnings++;
+    fprintf(diag_out(), "%s\n", msg);
+    if (fatal && !cc->error[0]) snprintf(cc->error, sizeof(cc->error), "%s", msg);
+}
+
+/* The library returns to sectorc_compile(); the command line exits. */
+static void bail_out(void) {
+    if (cc->bail_set) longjmp(cc->bail, 1);
+    exit(1);
+}
+
 static void error(const char *fmt, ...) {
     va_list ap;
-    fprintf(stderr, "%s:%d: error: ",
-            input_names[input_depth], input_lines[input_depth]);
     va_start(ap, fmt);
-    vfprintf(stderr, fmt, ap);
+    report("error", 1, fmt, ap);
     va_end(ap);
-    fprintf(stderr, "\n");
-    exit(1);
+    bail_out();
 }
 
 static void warn(const char *fmt, ...) {
     va_list ap;
-    fprintf(stderr, "%s:%d: warning: ",
-            input_names[input_depth], input_lines[input_depth]);
     va_start(ap, fmt);
-    vfprintf(stderr, fmt, ap);
+    report("warning", 0, fmt, ap);
     va_end(ap);
-    fprintf(stderr, "\n");
 }
 
 /* ============================================
@@ -210,8 +431,17 @@ static void warn(const char *fmt, ...) {
  * ============================================ */
 
 static struct type *new_type(int kind, int size, int align) {
-    if (num_types >= MAX_TYPES) error("too many types");
-    struct type *t = &types[num_types++];
+    if (!cc->st.type_blocks || cc->st.type_blocks->used == TYPE_BLOCK) {
+        struct type_block *b = cc->spare_types;
+        if (b) cc->spare_types = b->next;
+        else if (!(b = malloc(sizeof(struct type_block)))) error("out of memory");
+        b->next = cc->st.type_blocks;
+        b->used = 0;
+        cc->st.type_blocks = b;
+        cc->st.num_type_blocks++;
+    }
+    struct type *t = &cc->st.type_blocks->types[cc->st.type_blocks->used++];
+    cc->st.num_types++;
     memset(t, 0, sizeof(*t));
     t->kind = kind;
     t->size = size;
@@ -219,30 +449,93 @@ static struct type *new_type(int kind, int size, int align) {
     return t;
 }
 
-static struct type *ptr_to(struct type *base) {
-    struct type *t = new_type(TYPE_PTR, 8, 8);
+static unsigned hash_derived(int kind, struct type *base, int n, struct type **params) {
+    unsigned long h = (unsigned long)(uintptr_t)base >> 4;
+    h = h * 31 + (unsigned)kind;
+    h = h * 31 + (unsigned)n;
+    for (int i = 0; params && i < n; i++) h = h * 31 + ((uintptr_t)params[i] >> 4);
+    return (unsigned)(h ^ (h >> 16));
+}
+
+/*
+ * Derived types are hash-consed on (kind, base, count, parameter types):
+ * asking for the same pointer, array or function type twice returns the
+ * same object, so types can be compared by pointer.
+ */
+static struct type *derived_type(int kind, struct type *base, int n, struct type **params) {
+    if (cc->st.num_derived * 2 >= cc->st.derived_cap) {
+        int old_cap = cc->st.derived_cap;
+        struct type **old = cc->st.derived_index;
+        cc->st.derived_cap = cc->st.derived_cap ? cc->st.derived_cap * 2 : 256;
+        cc->st.derived_index = calloc(cc->st.derived_cap, sizeof(struct type *));
+        if (!cc->st.derived_index) error("out of memory");
+        for (int i = 0; i < old_cap; i++) {
+            if (!old[i]) continue;
+            unsigned h = hash_derived(old[i]->kind, old[i]->base, old[i]->array_size,
+                                      old[i]->params);
+            while (cc->st.derived_index[h & (cc->st.derived_cap - 1)]) h++;
+            cc->st.derived_index[h & (cc->st.derived_cap - 1)] = old[i];
+        }
+        free(old);
+    }
+
+    unsigned h = hash_derived(kind, base, n, params);
+    size_t psize = params && n > 0 ? sizeof(struct type *) * n : 0;
+    struct type *t;
+    for (; (t = cc->st.derived_index[h & (cc->st.derived_cap - 1)]) != NULL; h++) {
+        if (t->kind == kind && t->base == base && t->array_size == n &&
+            (!psize || memcmp(t->params, params, psize) == 0)) {
+            cc->st.derived_hits++;
+            return t;
+        }
+    }
+
+    if (kind == TYPE_PTR) t = new_type(TYPE_PTR, 8, 8);
+    else if (kind == TYPE_ARRAY) t = new_type(TYPE_ARRAY, base->size * n, base->align);
+    else t = new_type(kind, 0, 1);
     t->base = base;
+    t->array_size = n;
+    if (psize) {
+        if (!(t->params = malloc(psize))) error("out of memory");
+        memcpy(t->params, params, psize);
+    }
+    cc->st.derived_index[h & (cc->st.derived_cap - 1)] = t;
+    cc->st.num_derived++;
     return t;
 }
 
+static struct type *ptr_to(struct type *base) {
+    return derived_type(TYPE_PTR, base, 0, NULL);
+}
+
 static struct type *array_of(struct type *base, int size) {
-    struct type *t = new_type(TYPE_ARRAY, base->size * size, base->align);
-    t->base = base;
-    t->array_size = size;
-    return t;
+    return derived_type(TYPE_ARRAY, base, size, NULL);
+}
+
+/* nparams < 0 for an unprototyped f() */
+static struct type *func_type(struct type *ret, struct type **params, int nparams) {
+    return derived_type(TYPE_FUNC, ret, nparams, params);
+}
+
+static void report_types(void) {
+    fprintf(diag_out(), "types: %d (%d derived, %d lookups reused), "
+            "%d blocks, %lu bytes\n",
+            cc->st.num_types, cc->st.num_derived, cc->st.derived_hits, cc->st.num_type_blocks,
+            (unsigned long)(cc->st.num_type_blocks * sizeof(struct type_block) +
+                            cc->st.derived_cap * sizeof(struct type *)));
 }
 
 static void init_types(void) {
-    type_void = new_type(TYPE_VOID, 0, 1);
-    type_char = new_type(TYPE_CHAR, 1, 1);
-    new_type(TYPE_SHORT, 2, 2);
-    type_int = new_type(TYPE_INT, 4, 4);
-    type_long = new_type(TYPE_LONG, 8, 8);
+    cc->st.type_void = new_type(TYPE_VOID, 0, 1);
+    cc->st.type_char = new_type(TYPE_CHAR, 1, 1);
+    cc->st.type_short = new_type(TYPE_SHORT, 2, 2);
+    cc->st.type_int = new_type(TYPE_INT, 4, 4);
+    cc->st.type_long = new_type(TYPE_LONG, 8, 8);
     new_type(TYPE_UCHAR, 1, 1);
     new_type(TYPE_USHORT, 2, 2);
     new_type(TYPE_UINT, 4, 4);
     new_type(TYPE_ULONG, 8, 8);
-    type_bool = new_type(TYPE_BOOL, 1, 1);  /* C99 _Bool */
+    cc->st.type_bool = new_type(TYPE_BOOL, 1, 1);  /* C99 _Bool */
 }
 
 /* ============================================
@@ -250,13 +543,13 @@ static void init_types(void) {
  * ============================================ */
 
 static struct symbol *find_symbol(const char *name) {
-    for (int i = num_locals - 1; i >= 0; i--) {
-        if (strcmp(locals[i].name, name) == 0)
-            return &locals[i];
+    for (int i = cc->st.num_locals - 1; i >= 0; i--) {
+        if (strcmp(cc->st.locals[i].name, name) == 0)
+            return &cc->st.locals[i];
     }
-    for (int i = num_symbols - 1; i >= 0; i--) {
-        if (strcmp(symbols[i].name, name) == 0)
-            return &symbols[i];
+    for (int i = cc->st.num_symbols - 1; i >= 0; i--) {
+        if (strcmp(cc->st.symbols[i].name, name) == 0)
+            return &cc->st.symbols[i];
     }
     return NULL;
 }
@@ -264,11 +557,11 @@ static struct symbol *find_symbol(const char *name) {
 static struct symbol *add_symbol(const char *name, int kind, int storage, struct type *type) {
     struct symbol *sym;
     if (storage == SC_LOCAL || storage == SC_PARAM) {
-        if (num_locals >= MAX_LOCALS) error("too many locals");
-        sym = &locals[num_locals++];
+        if (cc->st.num_locals >= MAX_LOCALS) error("too many locals");
+        sym = &cc->st.locals[cc->st.num_locals++];
     } else {
-        if (num_symbols >= MAX_SYMBOLS) error("too many symbols");
-        sym = &symbols[num_symbols++];
+        if (cc->st.num_symbols >= MAX_SYMBOLS) error("too many symbols");
+        sym = &cc->st.symbols[cc->st.num_symbols++];
     }
     memset(sym, 0, sizeof(*sym));
     strncpy(sym->name, name, MAX_IDENT - 1);
@@ -276,159 +569,459 @@ static struct symbol *add_symbol(const char *name, int kind, int storage, struct
     sym->storage = storage;
     sym->type = type;
     if (storage == SC_LOCAL || storage == SC_PARAM) {
-        local_offset += 8;
-        sym->offset = local_offset;
+        cc->st.local_offset += 8;
+        sym->offset = cc->st.local_offset;
     }
     return sym;
 }
 
+static const char *save_str(const char *str);
+static void free_macros(void);
+
 static struct type *find_tag(const char *name) {
-    for (int i = 0; i < num_types; i++) {
-        if (types[i].name[0] && strcmp(types[i].name, name) == 0)
-            return &types[i];
+    for (struct type_block *b = cc->st.type_blocks; b; b = b->next) {
+        for (int i = b->used - 1; i >= 0; i--) {
+            if (b->types[i].name[0] && strcmp(b->types[i].name, name) == 0)
+                return &b->types[i];
+        }
     }
     return NULL;
 }
 
+static const char *asm_name(struct symbol *s) {
+    return s->asm_name ? s->asm_name : s->name;
+}
+
+/* A static is private to its file: with several inputs its assembly name
+ * carries the file index, so two files can each have their own. */
+static struct symbol *add_file_symbol(const char *name, int kind, int is_static,
+                                      struct type *type) {
+    struct symbol *prev = find_symbol(name);
+    if (prev && prev->storage == SC_STATIC) is_static = 1;
+    struct symbol *s = add_symbol(name, kind, is_static ? SC_STATIC : SC_GLOBAL, type);
+    if (is_static && cc->st.num_files > 1) {
+        char buf[MAX_IDENT + 16];
+        snprintf(buf, sizeof(buf), "%s.%d", name, cc->st.file_index);
+        s->asm_name = save_str(buf);
+    }
+    return s;
+}
+
+/* Macros, tags, typedefs, enum constants and statics end with their file;
+ * only external functions and objects are shared with the files after it */
+static void end_file_scope(void) {
+    int n = 0;
+    for (int i = 0; i < cc->st.num_symbols; i++) {
+        struct symbol *s = &cc->st.symbols[i];
+        if (s->storage == SC_GLOBAL && (s->kind == SYM_VAR || s->kind == SYM_FUNC))
+            cc->st.symbols[n++] = *s;
+    }
+    cc->st.num_symbols = n;
+    for (struct type_block *b = cc->st.type_blocks; b; b = b->next)
+        for (int i = 0; i < b->used; i++) b->types[i].name[0] = '\0';
+    free_macros();
+    cc->st.file_index++;
+}
+
 /* ============================================
  * Lexer
  * ============================================ */
 
+/* Strings that must outlive the lexer state: token copies, include names */
+static const char *save_str(const char *str) {
+    size_t n = strlen(str) + 1;
+    if (!cc->st.str_chunks || cc->st.str_chunks->used + n > STR_CHUNK) {
+        struct str_chunk *c = malloc(sizeof(*c));
+        if (!c) error("out of memory");
+        c->next = cc->st.str_chunks;
+        c->used = 0;
+        cc->st.str_chunks = c;
+    }
+    char *p = cc->st.str_chunks->text + cc->st.str_chunks->used;
+    memcpy(p, str, n);
+    cc->st.str_chunks->used += n;
+    return p;
+}
+
+/* NULL if path is not a readable regular file; never calls error() */
+static char *load_file(const char *path, long *len) {
+    struct stat st;
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode)) { fclose(f); return NULL; }
+    *len = (long)st.st_size;
+    char *buf = malloc(*len + 1);
+    if (!buf || fread(buf, 1, *len, f) != (size_t)*len) {
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    buf[*len] = '\0';
+    fclose(f);
+    return buf;
+}
+
+/*
+ * Headers go through a cache kept in the context when cache_sources is
+ * set (the compile server does). An entry is reused while the file's
+ * inode, size and mtime are unchanged; the lexer gets its own copy.
+ */
+static char *load_header(const char *path, long *len) {
+    struct stat st;
+    if (!cc->cache_sources) return load_file(path, len);
+    if (stat(path, &st) != 0) return NULL;
+
+    struct source *src = NULL;
+    for (int i = 0; i < cc->num_sources; i++)
+        if (strcmp(cc->sources[i].path, path) == 0) { src = &cc->sources[i]; break; }
+    if (src && src->mtime == st.st_mtime && src->size == st.st_size && src->ino == st.st_ino) {
+        cc->source_hits++;
+    } else {
+        char *text = load_file(path, len);
+        if (!text) return NULL;
+        cc->source_misses++;
+        if (!src) {
+            if (cc->num_sources == cc->source_cap) {
+                cc->source_cap = cc->source_cap ? cc->source_cap * 2 : 64;
+                cc->sources = realloc(cc->sources, sizeof(struct source) * cc->source_cap);
+                if (!cc->sources) error("out of memory");
+            }
+            src = &cc->sources[cc->num_sources++];
+            src->path = strdup(path);
+        } else {
+            free(src->text);
+        }
+        src->text = text;
+        src->len = *len;
+        src->mtime = st.st_mtime;
+        src->size = st.st_size;
+        src->ino = st.st_ino;
+    }
+
+    char *buf = malloc(src->len + 1);
+    if (!buf) error("out of memory");
+    memcpy(buf, src->text, src->len + 1);
+    *len = src->len;
+    return buf;
+}
+
 static void next_char(void) {
-    if (input_depth < 0) { ch = EOF; return; }
-    ch = fgetc(input_files[input_depth]);
-    if (ch == '\n') input_lines[input_depth]++;
-    if (ch == EOF && input_depth > 0) {
-        fclose(input_files[input_depth]);
-        input_depth--;
+    int d = cc->st.input_depth;
+    if (d < 0) { cc->st.ch = EOF; return; }
+    if (cc->st.input_pos[d] < cc->st.input_len[d]) {
+        cc->st.ch = (unsigned char)cc->st.input_bufs[d][cc->st.input_pos[d]++];
+        if (cc->st.ch == '\n') cc->st.input_lines[d]++;
+        return;
+    }
+    cc->st.ch = EOF;
+    if (d > 0) {
+        free(cc->st.input_bufs[d]);
+        cc->st.input_bufs[d] = NULL;
+        cc->st.input_depth--;
         next_char();
     }
 }
 
+/*
+ * Character classes for the lexer's hot loops, indexed by c + 1 so that
+ * EOF (-1) is a valid index. Plain ASCII, independent of the locale.
+ */
+enum { CC_SPACE = 1, CC_DIGIT = 2, CC_XDIGIT = 4, CC_IDSTART = 8, CC_IDCHAR = 16 };
+
+static unsigned char char_class[257];
+
+#define CHAR_IS(c, cls) (char_class[(c) + 1] & (cls))
+
+static void init_char_class(void) {
+    for (int c = 0; c < 256; c++) {
+        unsigned char k = 0;
+        if (c == ' ' || (c >= '\t' && c <= '\r')) k |= CC_SPACE;
+        if (c >= '0' && c <= '9') k |= CC_DIGIT | CC_XDIGIT | CC_IDCHAR;
+        if ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) k |= CC_XDIGIT;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+            k |= CC_IDSTART | CC_IDCHAR;
+        char_class[c + 1] = k;
+    }
+}
+
+/*
+ * Bulk scanning over the input buffer, 16 bytes at a time with SSE2 or
+ * NEON when available. Each scanner returns the first byte that stops
+ * it and adds the newlines it skipped to *lines. The scalar loops are the
+ * reference behaviour and handle the tail; --no-simd forces them.
+ */
+enum { SCAN_SPACE, SCAN_IDENT, SCAN_CHAR, SCAN_STRING };
+
+static int scan_stops(int c, int kind, int stop) {
+    switch (kind) {
+        case SCAN_SPACE: return !CHAR_IS(c, CC_SPACE);
+        case SCAN_IDENT: return !CHAR_IS(c, CC_IDCHAR);
+        case SCAN_CHAR: return c == stop;
+        default: return c == '"' || c == '\\' || c == '\n';
+    }
+}
+
+#if defined(__SSE2__)
+#define HAVE_SIMD_SCAN 1
+/* Bit i set when p[i] stops the scan; *nl gets the newline bits. */
+static unsigned scan_block(const char *p, int kind, int stop, unsigned *nl) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i m;
+    *nl = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    switch (kind) {
+        case SCAN_SPACE: {
+            /* ' ' or '\t'..'\r': (c - 9) as unsigned <= 4 */
+            __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(9));
+            m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                             _mm_cmpeq_epi8(_mm_max_epu8(d, _mm_set1_epi8(4)), _mm_set1_epi8(4)));
+            return ~(unsigned)_mm_movemask_epi8(m) & 0xFFFF;
+        }
+        case SCAN_IDENT: {
+            __m128i l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+            __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+            m = _mm_cmpeq_epi8(_mm_max_epu8(l, _mm_set1_epi8(25)), _mm_set1_epi8(25));
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(d, _mm_set1_epi8(9)), _mm_set1_epi8(9)));
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+            return ~(unsigned)_mm_movemask_epi8(m) & 0xFFFF;
+        }
+        case SCAN_CHAR:
+            return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)stop)));
+        default:
+            m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+            return (unsigned)_mm_movemask_epi8(m) | *nl;
+    }
+}
+#elif defined(__ARM_NEON)
+#define HAVE_SIMD_SCAN 1
+static unsigned neon_movemask(uint8x16_t v) {
+    static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+                                      1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t m = vandq_u8(v, vld1q_u8(bits));
+    return vaddv_u8(vget_low_u8(m)) | ((unsigned)vaddv_u8(vget_high_u8(m)) << 8);
+}
+
+static unsigned scan_block(const char *p, int kind, int stop, unsigned *nl) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)p);
+    uint8x16_t m;
+    *nl = neon_movemask(vceqq_u8(v, vdupq_n_u8('\n')));
+    switch (kind) {
+        case SCAN_SPACE:
+            m = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                         vcleq_u8(vsubq_u8(v, vdupq_n_u8(9)), vdupq_n_u8(4)));
+            return ~neon_movemask(m) & 0xFFFF;
+        case SCAN_IDENT:
+            m = vcleq_u8(vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a')), vdupq_n_u8(25));
+            m = vorrq_u8(m, vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9)));
+            m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('_')));
+            return ~neon_movemask(m) & 0xFFFF;
+        case SCAN_CHAR:
+            return neon_movemask(vceqq_u8(v, vdupq_n_u8((uint8_t)stop)));
+        default:
+            m = vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\')));
+            return neon_movemask(m) | *nl;
+    }
+}
+#endif
+
+static const char *scan(const char *p, const char *end, int kind, int stop, int *lines) {
+#ifdef HAVE_SIMD_SCAN
+    if (cc->use_simd) {
+        while (end - p >= 16) {
+            unsigned nl;
+            unsigned hit = scan_block(p, kind, stop, &nl);
+            if (hit) {
+                int k = __builtin_ctz(hit);
+                *lines += __builtin_popcount(nl & ((1u << k) - 1));
+                return p + k;
+            }
+            *lines += __builtin_popcount(nl);
+            p += 16;
+        }
+    }
+#endif
+    while (p < end && !scan_stops((unsigned char)*p, kind, stop)) {
+        if (*p == '\n') (*lines)++;
+        p++;
+    }
+    return p;
+}
+
+/* Skip ahead in the current file; ch becomes the byte that stopped the scan. */
+static void scan_input(int kind, int stop) {
+    int d = cc->st.input_depth;
+    if (d < 0) return;
+    char *buf = cc->st.input_bufs[d];
+    const char *q = scan(buf + cc->st.input_pos[d], buf + cc->st.input_len[d],
+                         kind, stop, &cc->st.input_lines[d]);
+    cc->st.input_pos[d] = q - buf;
+    next_char();
+}
+
 static void skip_whitespace(void) {
-    while (isspace(ch)) next_char();
+    while (CHAR_IS(cc->st.ch, CC_SPACE)) scan_input(SCAN_SPACE, 0);
 }
 
 static void skip_line(void) {
-    while (ch != '\n' && ch != EOF) next_char();
-}
-
-static int is_ident_start(int c) { return isalpha(c) || c == '_'; }
-static int is_ident_char(int c) { return isalnum(c) || c == '_'; }
-
-static int keyword(const char *s) {
-    static const struct { const char *name; int tok; } kw[] = {
-        {"int", TK_INT}, {"char", TK_CHAR_KW}, {"void", TK_VOID},
-        {"short", TK_SHORT}, {"long", TK_LONG},
-        {"signed", TK_SIGNED}, {"unsigned", TK_UNSIGNED},
-        {"float", TK_FLOAT}, {"double", TK_DOUBLE},
-        {"struct", TK_STRUCT}, {"union", TK_UNION}, {"enum", TK_ENUM},
-        {"typedef", TK_TYPEDEF},
-        {"if", TK_IF}, {"else", TK_ELSE}, {"while", TK_WHILE},
-        {"for", TK_FOR}, {"do", TK_DO},
-        {"switch", TK_SWITCH}, {"case", TK_CASE}, {"default", TK_DEFAULT},
-        {"break", TK_BREAK}, {"continue", TK_CONTINUE},
-        {"return", TK_RETURN}, {"goto", TK_GOTO}, {"sizeof", TK_SIZEOF},
-        {"static", TK_STATIC}, {"extern", TK_EXTERN},
-        {"const", TK_CONST}, {"volatile", TK_VOLATILE},
-        {"auto", TK_AUTO}, {"register", TK_REGISTER},
-        /* C99 keywords */
-        {"_Bool", TK_BOOL}, {"inline", TK_INLINE}, {"restrict", TK_RESTRICT},
-        {NULL, 0}
-    };
-    for (int i = 0; kw[i].name; i++) {
-        if (strcmp(s, kw[i].name) == 0) return kw[i].tok;
+    while (cc->st.ch != '\n' && cc->st.ch != EOF) scan_input(SCAN_CHAR, '\n');
+}
+
+static int is_ident_start(int c) { return CHAR_IS(c, CC_IDSTART); }
+static int is_ident_char(int c) { return CHAR_IS(c, CC_IDCHAR); }
+
+static int hex_value(int c) {
+    return CHAR_IS(c, CC_DIGIT) ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+/* Keywords are picked out by first character and length, then one memcmp. */
+#define MATCH(str, tk) \
+    if (len == (int)sizeof(str) - 1 && memcmp(s, str, sizeof(str) - 1) == 0) return tk
+
+static int keyword(const char *s, int len) {
+    switch (s[0]) {
+        case '_': MATCH("_Bool", TK_BOOL); break;
+        case 'a': MATCH("auto", TK_AUTO); break;
+        case 'b': MATCH("break", TK_BREAK); break;
+        case 'c':
+            MATCH("char", TK_CHAR_KW); MATCH("case", TK_CASE);
+            MATCH("const", TK_CONST); MATCH("continue", TK_CONTINUE);
+            break;
+        case 'd':
+            MATCH("do", TK_DO); MATCH("double", TK_DOUBLE); MATCH("default", TK_DEFAULT);
+            break;
+        case 'e':
+            MATCH("else", TK_ELSE); MATCH("enum", TK_ENUM); MATCH("extern", TK_EXTERN);
+            break;
+        case 'f': MATCH("for", TK_FOR); MATCH("float", TK_FLOAT); break;
+        case 'g': MATCH("goto", TK_GOTO); break;
+        case 'i': MATCH("int", TK_INT); MATCH("if", TK_IF); MATCH("inline", TK_INLINE); break;
+        case 'l': MATCH("long", TK_LONG); break;
+        case 'r':
+            MATCH("return", TK_RETURN); MATCH("register", TK_REGISTER);
+            MATCH("restrict", TK_RESTRICT);
+            break;
+        case 's':
+            MATCH("short", TK_SHORT); MATCH("signed", TK_SIGNED); MATCH("sizeof", TK_SIZEOF);
+            MATCH("static", TK_STATIC); MATCH("struct", TK_STRUCT); MATCH("switch", TK_SWITCH);
+            break;
+        case 't': MATCH("typedef", TK_TYPEDEF); break;
+        case 'u': MATCH("unsigned", TK_UNSIGNED); MATCH("union", TK_UNION); break;
+        case 'v': MATCH("void", TK_VOID); MATCH("volatile", TK_VOLATILE); break;
+        case 'w': MATCH("while", TK_WHILE); break;
     }
     return TK_IDENT;
 }
 
+/* Preprocessor directives */
+enum { PP_OTHER, PP_DEFINE, PP_INCLUDE, PP_CONDITIONAL };
+
+static int directive(const char *s, int len) {
+    switch (s[0]) {
+        case 'd': MATCH("define", PP_DEFINE); break;
+        case 'e':
+            MATCH("else", PP_CONDITIONAL); MATCH("elif", PP_CONDITIONAL);
+            MATCH("endif", PP_CONDITIONAL);
+            break;
+        case 'i':
+            MATCH("include", PP_INCLUDE); MATCH("if", PP_CONDITIONAL);
+            MATCH("ifdef", PP_CONDITIONAL); MATCH("ifndef", PP_CONDITIONAL);
+            break;
+    }
+    return PP_OTHER;
+}
+
+#undef MATCH
+
 static struct macro *find_macro(const char *name) {
-    for (int i = 0; i < num_macros; i++) {
-        if (strcmp(macros[i].name, name) == 0) return &macros[i];
+    for (int i = 0; i < cc->st.num_macros; i++) {
+        if (strcmp(cc->st.macros[i].name, name) == 0) return &cc->st.macros[i];
     }
     return NULL;
 }
 
 static void handle_define(void) {
     skip_whitespace();
-    if (num_macros >= MAX_DEFINES) error("too many macros");
-    struct macro *m = &macros[num_macros];
+    if (cc->st.num_macros >= MAX_DEFINES) error("too many macros");
+    struct macro *m = &cc->st.macros[cc->st.num_macros];
     memset(m, 0, sizeof(*m));
 
     int i = 0;
-    while (is_ident_char(ch) && i < MAX_IDENT - 1) {
-        m->name[i++] = ch;
+    while (is_ident_char(cc->st.ch) && i < MAX_IDENT - 1) {
+        m->name[i++] = cc->st.ch;
         next_char();
     }
     m->name[i] = '\0';
 
-    if (ch == '(') {
+    if (cc->st.ch == '(') {
         m->is_function = 1;
         next_char();
-        while (ch != ')' && ch != EOF) {
+        while (cc->st.ch != ')' && cc->st.ch != EOF) {
             skip_whitespace();
             i = 0;
-            while (is_ident_char(ch) && i < MAX_IDENT - 1) {
-                m->args[m->num_args][i++] = ch;
+            while (is_ident_char(cc->st.ch) && i < MAX_IDENT - 1) {
+                m->args[m->num_args][i++] = cc->st.ch;
                 next_char();
             }
             m->args[m->num_args][i] = '\0';
             m->num_args++;
             skip_whitespace();
-            if (ch == ',') next_char();
+            if (cc->st.ch == ',') next_char();
         }
-        if (ch == ')') next_char();
+        if (cc->st.ch == ')') next_char();
     }
 
     skip_whitespace();
     char buf[1024];
     i = 0;
-    while (ch != '\n' && ch != EOF && i < 1023) {
-        buf[i++] = ch;
+    while (cc->st.ch != '\n' && cc->st.ch != EOF && i < 1023) {
+        buf[i++] = cc->st.ch;
         next_char();
     }
     buf[i] = '\0';
     m->body = strdup(buf);
-    num_macros++;
+    cc->st.num_macros++;
 }
 
 static void handle_include(void) {
     skip_whitespace();
-    char delim = ch;
+    char delim = cc->st.ch;
     if (delim != '"' && delim != '<') { skip_line(); return; }
     char end = (delim == '"') ? '"' : '>';
     next_char();
 
     char path[256];
     int i = 0;
-    while (ch != end && ch != '\n' && ch != EOF && i < 255) {
-        path[i++] = ch;
+    while (cc->st.ch != end && cc->st.ch != '\n' && cc->st.ch != EOF && i < 255) {
+        path[i++] = cc->st.ch;
         next_char();
     }
     path[i] = '\0';
-    if (ch == end) next_char();
+    if (cc->st.ch == end) next_char();
 
-    if (input_depth >= MAX_INCLUDE - 1) {
+    if (cc->st.input_depth >= MAX_INCLUDE - 1) {
         warn("include depth exceeded");
         return;
     }
 
-    FILE *f = fopen(path, "r");
-    if (!f) {
+    long len;
+    char *buf = load_header(path, &len);
+    if (!buf) {
         /* Try include directory */
         char full[512];
         snprintf(full, sizeof(full), "include/%s", path);
-        f = fopen(full, "r");
+        buf = load_header(full, &len);
     }
-    if (!f) {
+    if (!buf) {
         warn("cannot open include file: %s", path);
         return;
     }
 
-    input_depth++;
-    input_files[input_depth] = f;
-    input_names[input_depth] = strdup(path);
-    input_lines[input_depth] = 1;
+    cc->st.input_depth++;
+    cc->st.input_bufs[cc->st.input_depth] = buf;
+    cc->st.input_pos[cc->st.input_depth] = 0;
+    cc->st.input_len[cc->st.input_depth] = len;
+    cc->st.input_names[cc->st.input_depth] = save_str(path);
+    cc->st.input_lines[cc->st.input_depth] = 1;
     next_char();
 }
 
@@ -437,26 +1030,25 @@ static void handle_preprocessor(void) {
     skip_whitespace();
     char dir[64];
     int i = 0;
-    while (is_ident_char(ch) && i < 63) {
-        dir[i++] = ch;
+    while (is_ident_char(cc->st.ch) && i < 63) {
+        dir[i++] = cc->st.ch;
         next_char();
     }
     dir[i] = '\0';
 
-    if (strcmp(dir, "define") == 0) handle_define();
-    else if (strcmp(dir, "include") == 0) handle_include();
-    else if (strcmp(dir, "ifdef") == 0 || strcmp(dir, "ifndef") == 0 ||
-             strcmp(dir, "if") == 0 || strcmp(dir, "else") == 0 ||
-             strcmp(dir, "elif") == 0 || strcmp(dir, "endif") == 0) {
-        skip_line();  /* Simplified: skip conditional compilation */
-    } else {
-        skip_line();
+    switch (directive(dir, i)) {
+        case PP_DEFINE: handle_define(); break;
+        case PP_INCLUDE: handle_include(); break;
+        case PP_CONDITIONAL:
+            skip_line();  /* Simplified: skip conditional compilation */
+            break;
+        default: skip_line(); break;
     }
 }
 
 static int read_escape(void) {
     next_char();
-    switch (ch) {
+    switch (cc->st.ch) {
         case 'n': return '\n';
         case 't': return '\t';
         case 'r': return '\r';
@@ -467,17 +1059,24 @@ static int read_escape(void) {
         case 'x': {
             next_char();
             int v = 0;
-            while (isxdigit(ch)) {
-                v = v * 16 + (isdigit(ch) ? ch - '0' : (ch | 0x20) - 'a' + 10);
+            while (CHAR_IS(cc->st.ch, CC_XDIGIT)) {
+                v = v * 16 + hex_value(cc->st.ch);
                 next_char();
             }
+            /* Step back so the caller's next_char lands after the digits */
+            int d = cc->st.input_depth;
+            if (cc->st.ch != EOF) {
+                if (cc->st.ch == '\n') cc->st.input_lines[d]--;
+                cc->st.input_pos[d]--;
+            }
+            cc->st.ch = (unsigned char)cc->st.input_bufs[d][cc->st.input_pos[d] - 1];
             return v;
         }
-        default: return ch;
+        default: return cc->st.ch;
     }
 }
 
-static void next_token(void);
+static void lex_token(void);
 
 static void expand_macro(struct macro *m) {
     if (!m->is_function) {
@@ -487,155 +1086,178 @@ static void expand_macro(struct macro *m) {
         return;
     }
     /* Function-like macro: skip for now */
-    next_token();
+    lex_token();
 }
 
-static void next_token(void) {
+static void lex_token(void) {
 again:
     skip_whitespace();
 
-    if (ch == EOF) { token = TK_EOF; return; }
-    if (ch == '#') { handle_preprocessor(); goto again; }
+    if (cc->st.ch == EOF) { token = TK_EOF; return; }
+    if (cc->st.ch == '#') { handle_preprocessor(); goto again; }
 
-    if (ch == '/') {
+    if (cc->st.ch == '/') {
         next_char();
-        if (ch == '/') { skip_line(); goto again; }
-        if (ch == '*') {
+        if (cc->st.ch == '/') { skip_line(); goto again; }
+        if (cc->st.ch == '*') {
             next_char();
-            while (ch != EOF) {
-                if (ch == '*') {
+            while (cc->st.ch != EOF) {
+                if (cc->st.ch == '*') {
                     next_char();
-                    if (ch == '/') { next_char(); break; }
-                } else next_char();
+                    if (cc->st.ch == '/') { next_char(); break; }
+                } else scan_input(SCAN_CHAR, '*');
             }
             goto again;
         }
-        if (ch == '=') { next_char(); token = TK_SLASHEQ; return; }
+        if (cc->st.ch == '=') { next_char(); token = TK_SLASHEQ; return; }
         token = TK_SLASH;
         return;
     }
 
-    if (is_ident_start(ch)) {
+    if (is_ident_start(cc->st.ch)) {
         int i = 0;
-        while (is_ident_char(ch) && i < MAX_TOKEN - 1) {
-            token_str[i++] = ch;
-            next_char();
-        }
+        token_str[i++] = cc->st.ch;
+        int d = cc->st.input_depth;
+        const char *p = cc->st.input_bufs[d] + cc->st.input_pos[d];
+        const char *q = scan(p, cc->st.input_bufs[d] + cc->st.input_len[d],
+                             SCAN_IDENT, 0, &cc->st.input_lines[d]);
+        long n = q - p;
+        if (n > MAX_TOKEN - 1 - i) n = MAX_TOKEN - 1 - i;
+        memcpy(token_str + i, p, n);
+        i += (int)n;
         token_str[i] = '\0';
+        cc->st.lex_wrote_str = 1;
+        cc->st.input_pos[d] += q - p;
+        next_char();
 
         struct macro *m = find_macro(token_str);
         if (m) { expand_macro(m); return; }
 
-        token = keyword(token_str);
+        token = keyword(token_str, i);
         return;
     }
 
-    if (isdigit(ch)) {
+    if (CHAR_IS(cc->st.ch, CC_DIGIT)) {
         token_val = 0;
-        if (ch == '0') {
+        if (cc->st.ch == '0') {
             next_char();
-            if (ch == 'x' || ch == 'X') {
+            if (cc->st.ch == 'x' || cc->st.ch == 'X') {
                 next_char();
-                while (isxdigit(ch)) {
-                    token_val = token_val * 16 +
-                        (isdigit(ch) ? ch - '0' : (ch | 0x20) - 'a' + 10);
+                while (CHAR_IS(cc->st.ch, CC_XDIGIT)) {
+                    token_val = token_val * 16 + hex_value(cc->st.ch);
                     next_char();
                 }
             } else {
-                while (ch >= '0' && ch <= '7') {
-                    token_val = token_val * 8 + ch - '0';
+                while (cc->st.ch >= '0' && cc->st.ch <= '7') {
+                    token_val = token_val * 8 + cc->st.ch - '0';
                     next_char();
                 }
             }
         } else {
-            while (isdigit(ch)) {
-                token_val = token_val * 10 + ch - '0';
+            while (CHAR_IS(cc->st.ch, CC_DIGIT)) {
+                token_val = token_val * 10 + cc->st.ch - '0';
                 next_char();
             }
         }
-        while (ch == 'l' || ch == 'L' || ch == 'u' || ch == 'U') next_char();
+        while (cc->st.ch == 'l' || cc->st.ch == 'L' || cc->st.ch == 'u' || cc->st.ch == 'U') next_char();
         token = TK_NUM;
         return;
     }
 
-    if (ch == '\'') {
+    if (cc->st.ch == '\'') {
         next_char();
-        token_val = (ch == '\\') ? read_escape() : ch;
+        token_val = (cc->st.ch == '\\') ? read_escape() : cc->st.ch;
         next_char();
-        if (ch == '\'') next_char();
+        if (cc->st.ch == '\'') next_char();
         token = TK_CHAR;
         return;
     }
 
-    if (ch == '"') {
+    if (cc->st.ch == '"') {
         next_char();
         int i = 0;
-        while (ch != '"' && ch != EOF && i < MAX_TOKEN - 1) {
-            token_str[i++] = (ch == '\\') ? read_escape() : ch;
-            if (ch != '\\') next_char();
+        while (cc->st.ch != '"' && cc->st.ch != EOF && i < MAX_TOKEN - 1) {
+            if (cc->st.ch == '\\') {
+                token_str[i++] = read_escape();
+                next_char();
+                continue;
+            }
+            token_str[i++] = cc->st.ch;
+            /* Copy the plain run up to the next quote, escape or newline */
+            int d = cc->st.input_depth;
+            const char *p = cc->st.input_bufs[d] + cc->st.input_pos[d];
+            const char *q = scan(p, cc->st.input_bufs[d] + cc->st.input_len[d],
+                                 SCAN_STRING, 0, &cc->st.input_lines[d]);
+            long n = q - p;
+            if (n > MAX_TOKEN - 1 - i) n = MAX_TOKEN - 1 - i;
+            memcpy(token_str + i, p, n);
+            i += (int)n;
+            cc->st.input_pos[d] += n;
+            next_char();
         }
         token_str[i] = '\0';
-        if (ch == '"') next_char();
+        cc->st.lex_wrote_str = 1;
+        if (cc->st.ch == '"') next_char();
         token = TK_STR;
         return;
     }
 
-    int c = ch;
+    int c = cc->st.ch;
     next_char();
 
     switch (c) {
         case '+':
-            if (ch == '+') { next_char(); token = TK_INC; }
-            else if (ch == '=') { next_char(); token = TK_PLUSEQ; }
+            if (cc->st.ch == '+') { next_char(); token = TK_INC; }
+            else if (cc->st.ch == '=') { next_char(); token = TK_PLUSEQ; }
             else token = TK_PLUS;
             break;
         case '-':
-            if (ch == '-') { next_char(); token = TK_DEC; }
-            else if (ch == '=') { next_char(); token = TK_MINUSEQ; }
-            else if (ch == '>') { next_char(); token = TK_ARROW; }
+            if (cc->st.ch == '-') { next_char(); token = TK_DEC; }
+            else if (cc->st.ch == '=') { next_char(); token = TK_MINUSEQ; }
+            else if (cc->st.ch == '>') { next_char(); token = TK_ARROW; }
             else token = TK_MINUS;
             break;
         case '*':
-            token = (ch == '=') ? (next_char(), TK_STAREQ) : TK_STAR;
+            token = (cc->st.ch == '=') ? (next_char(), TK_STAREQ) : TK_STAR;
             break;
         case '%':
-            token = (ch == '=') ? (next_char(), TK_MODEQ) : TK_MOD;
+            token = (cc->st.ch == '=') ? (next_char(), TK_MODEQ) : TK_MOD;
             break;
         case '&':
-            if (ch == '&') { next_char(); token = TK_LAND; }
-            else if (ch == '=') { next_char(); token = TK_ANDEQ; }
+            if (cc->st.ch == '&') { next_char(); token = TK_LAND; }
+            else if (cc->st.ch == '=') { next_char(); token = TK_ANDEQ; }
             else token = TK_AMP;
             break;
         case '|':
-            if (ch == '|') { next_char(); token = TK_LOR; }
-            else if (ch == '=') { next_char(); token = TK_OREQ; }
+            if (cc->st.ch == '|') { next_char(); token = TK_LOR; }
+            else if (cc->st.ch == '=') { next_char(); token = TK_OREQ; }
             else token = TK_OR;
             break;
         case '^':
-            token = (ch == '=') ? (next_char(), TK_XOREQ) : TK_XOR;
+            token = (cc->st.ch == '=') ? (next_char(), TK_XOREQ) : TK_XOR;
             break;
         case '~': token = TK_TILDE; break;
         case '!':
-            token = (ch == '=') ? (next_char(), TK_NE) : TK_LNOT;
+            token = (cc->st.ch == '=') ? (next_char(), TK_NE) : TK_LNOT;
             break;
         case '<':
-            if (ch == '=') { next_char(); token = TK_LE; }
-            else if (ch == '<') {
+            if (cc->st.ch == '=') { next_char(); token = TK_LE; }
+            else if (cc->st.ch == '<') {
                 next_char();
-                token = (ch == '=') ? (next_char(), TK_LSHIFTEQ) : TK_LSHIFT;
+                token = (cc->st.ch == '=') ? (next_char(), TK_LSHIFTEQ) : TK_LSHIFT;
             }
             else token = TK_LT;
             break;
         case '>':
-            if (ch == '=') { next_char(); token = TK_GE; }
-            else if (ch == '>') {
+            if (cc->st.ch == '=') { next_char(); token = TK_GE; }
+            else if (cc->st.ch == '>') {
                 next_char();
-                token = (ch == '=') ? (next_char(), TK_RSHIFTEQ) : TK_RSHIFT;
+                token = (cc->st.ch == '=') ? (next_char(), TK_RSHIFTEQ) : TK_RSHIFT;
             }
             else token = TK_GT;
             break;
         case '=':
-            token = (ch == '=') ? (next_char(), TK_EQ) : TK_ASSIGN;
+            token = (cc->st.ch == '=') ? (next_char(), TK_EQ) : TK_ASSIGN;
             break;
         case '(': token = TK_LPAREN; break;
         case ')': token = TK_RPAREN; break;
@@ -648,7 +1270,7 @@ again:
         case ':': token = TK_COLON; break;
         case '?': token = TK_QUEST; break;
         case '.':
-            if (ch == '.' && (next_char(), ch == '.')) {
+            if (cc->st.ch == '.' && (next_char(), cc->st.ch == '.')) {
                 next_char();
                 token = TK_ELLIPSIS;
             } else {
@@ -659,6 +1281,104 @@ again:
     }
 }
 
+/* ============================================
+ * Pipelined Lexing
+ * ============================================ */
+
+/*
+ * With --pipeline a lexer thread runs ahead of the parser and pushes
+ * tokens through a single-producer/single-consumer ring. Each slot holds
+ * the lexer globals as they stood after the token, so the parser sees
+ * exactly what the sequential lexer would have left behind. Lexer
+ * diagnostics travel through the ring and print when the parser gets
+ * to them.
+ */
+
+static void ring_push(int kind, const char *str) {
+    size_t head = atomic_load_explicit(&cc->st.ring_head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&cc->st.ring_tail, memory_order_acquire) == RING_SIZE) {
+        if (atomic_load(&cc->st.ring_abort)) pthread_exit(NULL);
+        sched_yield();
+    }
+    struct lex_slot *s = &cc->st.ring[head & (RING_SIZE - 1)];
+    s->kind = kind;
+    s->token = token;
+    s->val = token_val;
+    s->str = str;
+    s->name = cc->st.input_names[cc->st.input_depth];
+    s->line = cc->st.input_lines[cc->st.input_depth];
+    atomic_store_explicit(&cc->st.ring_head, head + 1, memory_order_release);
+}
+
+static void lex_message(char *msg, int fatal) {
+    ring_push(fatal ? LEX_ERROR : LEX_WARN, msg);
+    if (fatal) pthread_exit(NULL);
+}
+
+static void *lexer_main(void *arg) {
+    cc = arg;
+    in_lexer = 1;
+    do {
+        cc->st.lex_wrote_str = 0;
+        lex_token();
+        ring_push(LEX_TOKEN, cc->st.lex_wrote_str ? save_str(token_str) : NULL);
+    } while (token != TK_EOF);
+    return NULL;
+}
+
+static void free_str_chunks(void) {
+    while (cc->st.str_chunks) {
+        struct str_chunk *c = cc->st.str_chunks;
+        cc->st.str_chunks = c->next;
+        free(c);
+    }
+}
+
+static void start_lexer(void) {
+    cc->st.ring_eof = 0;
+    if (pthread_create(&cc->st.lexer_thread, NULL, lexer_main, cc) != 0)
+        error("cannot start lexer thread");
+    cc->st.lexer_running = 1;
+}
+
+/* abort: the parser gave up, so stop the lexer even if it is blocked */
+static void stop_lexer(int abort) {
+    if (abort) atomic_store(&cc->st.ring_abort, 1);
+    pthread_join(cc->st.lexer_thread, NULL);
+    cc->st.lexer_running = 0;
+    free_str_chunks();
+}
+
+static void next_token(void) {
+    if (!cc->pipeline) { lex_token(); return; }
+    while (!cc->st.ring_eof) {
+        size_t tail = atomic_load_explicit(&cc->st.ring_tail, memory_order_relaxed);
+        while (atomic_load_explicit(&cc->st.ring_head, memory_order_acquire) == tail)
+            sched_yield();
+        struct lex_slot s = cc->st.ring[tail & (RING_SIZE - 1)];
+        atomic_store_explicit(&cc->st.ring_tail, tail + 1, memory_order_release);
+
+        if (s.kind != LEX_TOKEN) {
+            fprintf(diag_out(), "%s\n", s.str);
+            if (s.kind == LEX_WARN) cc->st.num_warnings++;
+            if (s.kind == LEX_ERROR) {
+                snprintf(cc->error, sizeof(cc->error), "%s", s.str);
+                free((char *)s.str);
+                bail_out();
+            }
+            free((char *)s.str);
+            continue;
+        }
+        token = s.token;
+        token_val = s.val;
+        if (s.str) strcpy(token_str, s.str);
+        cc->st.tok_name = s.name;
+        cc->st.tok_line = s.line;
+        if (token == TK_EOF) cc->st.ring_eof = 1;
+        return;
+    }
+}
+
 static void expect(int tk) {
     if (token != tk) error("expected token %d, got %d", tk, token);
     next_token();
@@ -668,27 +1388,29 @@ static void expect(int tk) {
  * Code Generation
  * ============================================ */
 
+static void flush_pending(void);
+
 static void emit(const char *fmt, ...) {
     va_list ap;
-    fprintf(output_file, "    ");
+    if (!cc->st.reachable) return;
+    flush_pending();
+    fprintf(cc->st.output_file, "    ");
     va_start(ap, fmt);
-    vfprintf(output_file, fmt, ap);
+    vfprintf(cc->st.output_file, fmt, ap);
     va_end(ap);
-    fprintf(output_file, "\n");
+    fprintf(cc->st.output_file, "\n");
 }
 
 static void emit_raw(const char *fmt, ...) {
     va_list ap;
+    flush_pending();
     va_start(ap, fmt);
-    vfprintf(output_file, fmt, ap);
+    vfprintf(cc->st.output_file, fmt, ap);
     va_end(ap);
-    fprintf(output_file, "\n");
+    fprintf(cc->st.output_file, "\n");
 }
 
-static int new_label(void) { return label_count++; }
-static void emit_label(int l) { fprintf(output_file, "L%d:\n", l); }
-
-static void emit_num(long v) {
+static void emit_imm(long v) {
     if (v >= 0 && v < 65536) emit("mov x0, #%ld", v);
     else if (v < 0 && v >= -65536) emit("mov x0, #%ld", v);
     else {
@@ -699,96 +1421,587 @@ static void emit_num(long v) {
     }
 }
 
-static void emit_push(void) { emit("str x0, [sp, #-16]!"); }
-static void emit_pop(void) { emit("ldr x1, [sp], #16"); }
+/*
+ * Reachability: code after return/break/continue/goto and the untaken arm
+ * of a constant condition is never written. Constants are held back in
+ * pending_imm so a controlling expression that folds emits nothing, and an
+ * unconditional jump is held back so a jump to the very next label vanishes.
+ */
+static void flush_pending(void) {
+    if (cc->st.pending_imm) {
+        cc->st.pending_imm = 0;
+        emit_imm(cc->st.pending_val);
+    }
+    if (cc->st.pending_jump >= 0) {
+        fprintf(cc->st.output_file, "    b L%d\n", cc->st.pending_jump);
+        cc->st.pending_jump = -1;
+    }
+}
 
-static void emit_prologue(const char *name, int size) {
-    emit_raw(".global _%s", name);
-    emit_raw("_%s:", name);
-    emit("stp x29, x30, [sp, #-16]!");
-    emit("mov x29, sp");
-    if (size > 0) {
-        size = (size + 15) & ~15;
-        emit("sub sp, sp, #%d", size);
+static void emit_num(long v) {
+    if (!cc->st.reachable) return;
+    flush_pending();
+    cc->st.pending_imm = 1;
+    cc->st.pending_val = v;
+}
+
+static int new_label(void) {
+    if (cc->st.label_count >= cc->st.label_cap) {
+        cc->st.label_cap = cc->st.label_cap ? cc->st.label_cap * 2 : 256;
+        cc->st.label_refs = realloc(cc->st.label_refs, sizeof(int) * cc->st.label_cap);
+        cc->st.label_reached = realloc(cc->st.label_reached, cc->st.label_cap);
+        if (!cc->st.label_refs || !cc->st.label_reached) error("out of memory");
     }
+    cc->st.label_refs[cc->st.label_count] = 0;
+    cc->st.label_reached[cc->st.label_count] = 0;
+    return cc->st.label_count++;
 }
 
-static void emit_epilogue(int size) {
-    if (size > 0) {
-        size = (size + 15) & ~15;
-        emit("add sp, sp, #%d", size);
+static void emit_label(int l) {
+    if (cc->st.pending_jump == l) {
+        cc->st.pending_jump = -1;
+        cc->st.label_refs[l]--;
+        cc->st.reachable = 1;
     }
-    emit("ldp x29, x30, [sp], #16");
-    emit("ret");
+    if (!cc->st.reachable && !cc->st.label_refs[l] && !cc->st.label_reached[l]) return;
+    flush_pending();
+    fprintf(cc->st.output_file, "L%d:\n", l);
+    cc->st.reachable = 1;
 }
 
-static void emit_load_local(int off) { emit("ldr x0, [x29, #-%d]", off); }
-static void emit_store_local(int off) { emit("str x0, [x29, #-%d]", off); }
-static void emit_load_global(const char *n) {
-    emit("adrp x0, _%s@PAGE", n);
-    emit("add x0, x0, _%s@PAGEOFF", n);
+static void emit_jump(int l) {
+    if (!cc->st.reachable) return;
+    flush_pending();
+    cc->st.label_refs[l]++;
+    cc->st.pending_jump = l;
+    cc->st.reachable = 0;
 }
-static void emit_deref(int sz) {
-    if (sz == 1) emit("ldrb w0, [x0]");
-    else if (sz == 2) emit("ldrh w0, [x0]");
-    else if (sz == 4) emit("ldr w0, [x0]");
-    else emit("ldr x0, [x0]");
+
+static void emit_branch(const char *op, int l) {
+    if (!cc->st.reachable) return;
+    emit("%s L%d", op, l);
+    cc->st.label_refs[l]++;
 }
-static void emit_store(int sz) {
-    if (sz == 1) emit("strb w1, [x0]");
-    else if (sz == 2) emit("strh w1, [x0]");
-    else if (sz == 4) emit("str w1, [x0]");
-    else emit("str x1, [x0]");
+
+/* Branch to l when x0 is zero (on_true = 0) or nonzero (on_true = 1). */
+static void emit_cond_jump(int on_true, int l) {
+    if (!cc->st.reachable) return;
+    if (cc->st.pending_imm) {
+        cc->st.pending_imm = 0;
+        if ((cc->st.pending_val != 0) != on_true) return;
+        if (on_true) { emit_jump(l); return; }
+        /* Nothing between here and l is live, so falling through reaches it */
+        cc->st.label_reached[l] = 1;
+        cc->st.reachable = 0;
+        return;
+    }
+    emit_branch(on_true ? "cbnz x0," : "cbz x0,", l);
 }
 
 /* ============================================
- * Expression Parsing
+ * Output Units
  * ============================================ */
 
-static struct type *parse_expr(void);
-static struct type *parse_assign(void);
-static struct type *parse_ternary(void);
-static struct type *parse_logor(void);
-static struct type *parse_logand(void);
-static struct type *parse_bitor(void);
-static struct type *parse_bitxor(void);
-static struct type *parse_bitand(void);
-static struct type *parse_equality(void);
-static struct type *parse_relational(void);
-static struct type *parse_shift(void);
-static struct type *parse_additive(void);
-static struct type *parse_multiplicative(void);
-static struct type *parse_unary(void);
-static struct type *parse_postfix(void);
-static struct type *parse_primary(void);
+static int add_unit(const char *name, const char *section) {
+    if (cc->st.num_units >= cc->st.unit_cap) {
+        cc->st.unit_cap = cc->st.unit_cap ? cc->st.unit_cap * 2 : 256;
+        cc->st.units = realloc(cc->st.units, sizeof(struct unit) * cc->st.unit_cap);
+        if (!cc->st.units) error("out of memory");
+    }
+    struct unit *u = &cc->st.units[cc->st.num_units];
+    memset(u, 0, sizeof(*u));
+    strncpy(u->name, name, MAX_IDENT - 1);
+    u->section = section;
+    u->live = !cc->whole_program;
+    return cc->st.num_units++;
+}
 
-static struct type *parse_expr(void) {
-    struct type *t = parse_assign();
-    while (token == TK_COMMA) {
-        next_token();
-        t = parse_assign();
+/* Temporary streams are tracked so that a failed compilation can close them */
+static FILE *open_temp(void) {
+    if (cc->st.num_temp_files >= MAX_TEMP_FILES) error("nesting too deep");
+    FILE *f = tmpfile();
+    if (!f) error("cannot create temporary file");
+    return cc->st.temp_files[cc->st.num_temp_files++] = f;
+}
+
+static void close_temp(FILE *f) {
+    for (int i = cc->st.num_temp_files - 1; i >= 0; i--) {
+        if (cc->st.temp_files[i] == f) {
+            cc->st.temp_files[i] = cc->st.temp_files[--cc->st.num_temp_files];
+            break;
+        }
     }
-    return t;
+    fclose(f);
 }
 
-static struct type *parse_assign(void) {
-    return parse_ternary();
+static void begin_unit(const char *name) {
+    cc->st.current_unit = add_unit(name, NULL);
+    cc->st.unit_saved_output = cc->st.output_file;
+    cc->st.output_file = open_temp();
 }
 
-static struct type *parse_ternary(void) {
-    struct type *t = parse_logor();
-    if (token == TK_QUEST) {
-        next_token();
-        int l1 = new_label(), l2 = new_label();
-        emit("cbz x0, L%d", l1);
-        parse_expr();
-        expect(TK_COLON);
-        emit("b L%d", l2);
-        emit_label(l1);
-        t = parse_ternary();
-        emit_label(l2);
-    }
-    return t;
+static char *read_unit_text(FILE *body) {
+    long size = ftell(body);
+    char *text = malloc(size + 1);
+    if (!text) error("out of memory");
+    rewind(body);
+    if (fread(text, 1, size, body) != (size_t)size) error("cannot read temporary file");
+    text[size] = '\0';
+    close_temp(body);
+    return text;
+}
+
+static void end_unit(void) {
+    FILE *body = cc->st.output_file;
+    flush_pending();
+    cc->st.output_file = cc->st.unit_saved_output;
+    cc->st.units[cc->st.current_unit].text = read_unit_text(body);
+    cc->st.current_unit = -1;
+}
+
+/* Divert output to a buffer; returns the stream to restore. */
+static FILE *begin_capture(void) {
+    FILE *saved = cc->st.output_file;
+    flush_pending();
+    cc->st.output_file = open_temp();
+    return saved;
+}
+
+static char *end_capture(FILE *saved) {
+    FILE *body = cc->st.output_file;
+    cc->st.output_file = saved;
+    return read_unit_text(body);
+}
+
+static void add_unit_ref(int from, const char *name) {
+    if (cc->st.num_unit_refs >= cc->st.unit_ref_cap) {
+        cc->st.unit_ref_cap = cc->st.unit_ref_cap ? cc->st.unit_ref_cap * 2 : 1024;
+        cc->st.unit_refs = realloc(cc->st.unit_refs, sizeof(struct unit_ref) * cc->st.unit_ref_cap);
+        if (!cc->st.unit_refs) error("out of memory");
+    }
+    cc->st.unit_refs[cc->st.num_unit_refs].from = from;
+    strncpy(cc->st.unit_refs[cc->st.num_unit_refs].name, name, MAX_IDENT - 1);
+    cc->st.unit_refs[cc->st.num_unit_refs].name[MAX_IDENT - 1] = '\0';
+    cc->st.num_unit_refs++;
+}
+
+/* Record that the unit being generated refers to a global symbol. */
+static void add_ref(const char *name) {
+    if (cc->st.current_unit < 0 || !cc->st.reachable) return;
+    add_unit_ref(cc->st.current_unit, name);
+}
+
+static unsigned hash_name(const char *s) {
+    unsigned h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+/* Mark every unit reachable from main through recorded references. */
+static void mark_live_units(void) {
+    int cap = 16;
+    while (cap < cc->st.num_units * 2) cap *= 2;
+    int *index = malloc(sizeof(int) * cap);
+    int *first = malloc(sizeof(int) * (cc->st.num_units + 1));
+    int *work = malloc(sizeof(int) * (cc->st.num_units + 1));
+    int *next = malloc(sizeof(int) * (cc->st.num_unit_refs + 1));
+    int *to = malloc(sizeof(int) * (cc->st.num_unit_refs + 1));
+    if (!index || !first || !work || !next || !to) error("out of memory");
+
+    for (int i = 0; i < cap; i++) index[i] = -1;
+    for (int i = 0; i < cc->st.num_units; i++) {
+        unsigned h = hash_name(cc->st.units[i].name) & (cap - 1);
+        while (index[h] >= 0) h = (h + 1) & (cap - 1);
+        index[h] = i;
+        first[i] = -1;
+    }
+
+    /* Resolve each reference and chain it onto its unit's list */
+    for (int i = 0; i < cc->st.num_unit_refs; i++) {
+        unsigned h = hash_name(cc->st.unit_refs[i].name) & (cap - 1);
+        to[i] = -1;
+        for (; index[h] >= 0; h = (h + 1) & (cap - 1)) {
+            if (strcmp(cc->st.units[index[h]].name, cc->st.unit_refs[i].name) == 0) {
+                to[i] = index[h];
+                break;
+            }
+        }
+        next[i] = first[cc->st.unit_refs[i].from];
+        first[cc->st.unit_refs[i].from] = i;
+    }
+
+    int main_unit = -1;
+    for (int i = 0; i < cc->st.num_units; i++)
+        if (!cc->st.units[i].section && strcmp(cc->st.units[i].name, "main") == 0) main_unit = i;
+
+    if (main_unit < 0) {
+        warn("whole-program mode: no main, keeping everything");
+        for (int i = 0; i < cc->st.num_units; i++) cc->st.units[i].live = 1;
+    } else {
+        int n = 0;
+        cc->st.units[main_unit].live = 1;
+        work[n++] = main_unit;
+        while (n > 0) {
+            int u = work[--n];
+            for (int r = first[u]; r >= 0; r = next[r]) {
+                int t = to[r];
+                if (t >= 0 && !cc->st.units[t].live) {
+                    cc->st.units[t].live = 1;
+                    work[n++] = t;
+                }
+            }
+        }
+    }
+    free(index); free(first); free(work); free(next); free(to);
+}
+
+/* Intern a string literal; identical literals share one label. */
+static int add_string(const char *str) {
+    if (cc->st.num_strings * 2 >= cc->st.string_index_cap) {
+        free(cc->st.string_index);
+        cc->st.string_index_cap = cc->st.string_index_cap ? cc->st.string_index_cap * 2 : 1024;
+        cc->st.string_index = malloc(sizeof(int) * cc->st.string_index_cap);
+        if (!cc->st.string_index) error("out of memory");
+        for (int i = 0; i < cc->st.string_index_cap; i++) cc->st.string_index[i] = -1;
+        for (int i = 0; i < cc->st.num_strings; i++) {
+            unsigned h = hash_name(cc->st.strings[i]) & (cc->st.string_index_cap - 1);
+            while (cc->st.string_index[h] >= 0) h = (h + 1) & (cc->st.string_index_cap - 1);
+            cc->st.string_index[h] = i;
+        }
+    }
+    unsigned h = hash_name(str) & (cc->st.string_index_cap - 1);
+    for (; cc->st.string_index[h] >= 0; h = (h + 1) & (cc->st.string_index_cap - 1))
+        if (strcmp(cc->st.strings[cc->st.string_index[h]], str) == 0) return cc->st.string_index[h];
+
+    if (cc->st.num_strings >= cc->st.string_cap) {
+        cc->st.string_cap = cc->st.string_cap ? cc->st.string_cap * 2 : 256;
+        cc->st.strings = realloc(cc->st.strings, sizeof(char *) * cc->st.string_cap);
+        if (!cc->st.strings) error("out of memory");
+    }
+    cc->st.strings[cc->st.num_strings] = strdup(str);
+    cc->st.string_index[h] = cc->st.num_strings;
+    return cc->st.num_strings++;
+}
+
+static const char *string_name(int idx) {
+    static _Thread_local char name[32];
+    snprintf(name, sizeof(name), "str%d", idx);
+    return name;
+}
+
+/* Write bytes as an assembler string, escaping anything unprintable. */
+static void emit_string_bytes(const char *dir, const char *s, int len) {
+    fprintf(cc->st.output_file, "    %s \"", dir);
+    for (int i = 0; i < len; i++) {
+        int c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') fprintf(cc->st.output_file, "\\%c", c);
+        else if (c < 32 || c >= 127) fprintf(cc->st.output_file, "\\%03o", c);
+        else fputc(c, cc->st.output_file);
+    }
+    fprintf(cc->st.output_file, "\"\n");
+}
+
+static int cmp_string_tail(const void *a, const void *b) {
+    const char *x = cc->st.strings[*(const int *)a], *y = cc->st.strings[*(const int *)b];
+    int i = (int)strlen(x), j = (int)strlen(y);
+    while (i > 0 && j > 0) {
+        unsigned char cx = x[--i], cy = y[--j];
+        if (cx != cy) return cx < cy ? -1 : 1;
+    }
+    return (i > 0) - (j > 0);
+}
+
+static _Thread_local int *string_host;     /* For the qsort comparator */
+
+static int cmp_string_host(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    if (string_host[x] != string_host[y]) return string_host[x] < string_host[y] ? -1 : 1;
+    size_t lx = strlen(cc->st.strings[x]), ly = strlen(cc->st.strings[y]);
+    return (lx < ly) - (lx > ly);
+}
+
+/*
+ * Turn the string table into units. A literal that is a suffix of a
+ * longer one is not stored again: its label points into the longer one.
+ * Sorting by reversed content puts every string right before the next
+ * longer string it is a suffix of.
+ */
+static void emit_strings(void) {
+    if (cc->st.num_strings == 0) return;
+    int *order = malloc(sizeof(int) * cc->st.num_strings);
+    int *host = malloc(sizeof(int) * cc->st.num_strings);
+    if (!order || !host) error("out of memory");
+    for (int i = 0; i < cc->st.num_strings; i++) order[i] = host[i] = i;
+    string_host = host;
+    qsort(order, cc->st.num_strings, sizeof(int), cmp_string_tail);
+    for (int k = cc->st.num_strings - 2; k >= 0; k--) {
+        const char *a = cc->st.strings[order[k]], *b = cc->st.strings[order[k + 1]];
+        int la = (int)strlen(a), lb = (int)strlen(b);
+        if (la < lb && memcmp(a, b + lb - la, la) == 0)
+            host[order[k]] = host[order[k + 1]];
+    }
+
+    /* Group each host with its aliases, longest first */
+    qsort(order, cc->st.num_strings, sizeof(int), cmp_string_host);
+    for (int k = 0; k < cc->st.num_strings; k++) {
+        int i = order[k];
+        int u = add_unit(string_name(i), ".section __TEXT,__cstring,cstring_literals");
+        if (host[i] != i) {
+            /* Alias: keeps its host alive, emits nothing itself */
+            cc->st.units[u].text = calloc(1, 1);
+            add_unit_ref(u, string_name(host[i]));
+            continue;
+        }
+        int len = (int)strlen(cc->st.strings[i]);
+        int pos = 0;
+        FILE *saved = begin_capture();
+        emit_raw("_str%d:", i);
+        /* Aliases become labels inside this string. That would defeat the
+         * linker's cstring merging, so such strings go in __TEXT,__const. */
+        for (int j = k + 1; j < cc->st.num_strings && host[order[j]] == i; j++) {
+            int tail = len - (int)strlen(cc->st.strings[order[j]]);
+            cc->st.units[u].section = ".const";
+            emit_string_bytes(".ascii", cc->st.strings[i] + pos, tail - pos);
+            pos = tail;
+            emit_raw("_str%d:", order[j]);
+        }
+        emit_string_bytes(".asciz", cc->st.strings[i] + pos, len - pos);
+        cc->st.units[u].text = end_capture(saved);
+    }
+    free(order);
+    free(host);
+}
+
+/* ============================================
+ * Unit Optimization
+ * ============================================ */
+
+/*
+ * Code is generated while parsing, so only the cleanup afterwards runs
+ * per unit: labels nobody branches to are dropped and, with --peephole,
+ * a few push/pop patterns are folded. A unit only reads its own text and
+ * the final label_refs, so with -j N the units are handed out to worker
+ * threads and the result does not depend on N. Label numbers come from
+ * the sequential front end and are unique across the file, so workers
+ * share nothing.
+ */
+
+#define PUSH_X0 "    str x0, [sp, #-16]!"
+#define POP_X0  "    ldr x0, [sp], #16"
+#define POP_X1  "    ldr x1, [sp], #16"
+
+static int line_is(const char *p, int len, const char *s) {
+    return len == (int)strlen(s) && memcmp(p, s, len) == 0;
+}
+
+static int line_starts(const char *p, int len, const char *s) {
+    int n = (int)strlen(s);
+    return len >= n && memcmp(p, s, n) == 0;
+}
+
+/* Sets x0 without reading x0, x1 or sp */
+static int defines_x0(const char *p, int len) {
+    return line_starts(p, len, "    mov x0, #") ||
+           line_starts(p, len, "    ldr x0, [x29, #") ||
+           line_starts(p, len, "    sub x0, x29, #") ||
+           line_starts(p, len, "    add x0, x29, #");
+}
+
+static void optimize_unit(struct unit *u) {
+    char *text = u->text;
+    if (!text[0]) return;
+    int cap = 16, n = 0, o = 0;
+    for (char *p = text; *p; p++) if (*p == '\n') cap++;
+    int *start = malloc(sizeof(int) * cap);    /* Output line offsets */
+    if (!start) return;                         /* Leave the unit as is */
+
+    char *p = text;
+    while (*p) {
+        char *nl = strchr(p, '\n');
+        int len = nl ? (int)(nl - p) : (int)strlen(p);
+        int l;
+        char c;
+        if (p[0] == 'L' && sscanf(p, "L%d%c", &l, &c) == 2 && c == ':' &&
+            cc->st.label_refs[l] == 0) {
+            p += len + (nl != NULL);
+            continue;
+        }
+        start[n++] = o;
+        memmove(text + o, p, len);
+        o += len;
+        text[o++] = '\n';
+        p += len + (nl != NULL);
+        if (!cc->peephole) continue;
+
+        char *last = text + start[n - 1];
+        char *prev = n >= 2 ? text + start[n - 2] : NULL;
+        int prev_len = prev ? (int)(last - prev) - 1 : 0;
+
+        /* push x0; pop x0 */
+        if (prev && line_is(last, len, POP_X0) && line_is(prev, prev_len, PUSH_X0)) {
+            n -= 2;
+            o = start[n];
+        }
+        /* str x0, [x29, #-N]; ldr x0, [x29, #-N] */
+        else if (prev && line_starts(last, len, "    ldr x0, [x29, #") &&
+                 line_starts(prev, prev_len, "    str x0, [x29, #") &&
+                 len == prev_len && memcmp(last + 7, prev + 7, len - 7) == 0) {
+            n--;
+            o = start[n];
+        }
+        /* push x0; <def x0>; pop x1  ->  mov x1, x0; <def x0> */
+        else if (n >= 3 && line_is(last, len, POP_X1) && defines_x0(prev, prev_len) &&
+                 line_is(text + start[n - 3], (int)(prev - text) - start[n - 3] - 1, PUSH_X0)) {
+            char def[256];
+            if (prev_len < (int)sizeof(def)) {
+                memcpy(def, prev, prev_len);
+                o = start[n - 3];
+                o += sprintf(text + o, "    mov x1, x0\n");
+                start[n - 2] = o;
+                memcpy(text + o, def, prev_len);
+                o += prev_len;
+                text[o++] = '\n';
+                n--;
+            }
+        }
+    }
+    text[o] = '\0';
+    free(start);
+}
+
+static void *optimize_worker(void *arg) {
+    cc = arg;
+    for (;;) {
+        int i = atomic_fetch_add(&cc->st.next_job, 1);
+        if (i >= cc->st.num_units) return NULL;
+        if (cc->st.units[i].live) optimize_unit(&cc->st.units[i]);
+    }
+}
+
+static void optimize_units(void) {
+    pthread_t threads[MAX_JOBS];
+    int n = cc->jobs < cc->st.num_units ? cc->jobs : cc->st.num_units;
+    int started = 0;
+    atomic_store(&cc->st.next_job, 0);
+    /* Workers must not call error(); if one fails to start the rest do its share */
+    while (started + 1 < n &&
+           pthread_create(&threads[started], NULL, optimize_worker, cc) == 0)
+        started++;
+    optimize_worker(cc);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+}
+
+/* Write all live units in source order. */
+static void emit_units(void) {
+    const char *section = ".text";
+    int dropped = 0;
+    if (cc->whole_program) mark_live_units();
+    optimize_units();
+    for (int i = 0; i < cc->st.num_units; i++) {
+        if (!cc->st.units[i].live) { dropped++; continue; }
+        if (!cc->st.units[i].text[0]) continue;
+        if (!cc->st.units[i].section) section = ".text";
+        else if (strcmp(cc->st.units[i].section, section) != 0) {
+            section = cc->st.units[i].section;
+            emit_raw("%s", section);
+        }
+        fputs(cc->st.units[i].text, cc->st.output_file);
+    }
+    if (cc->whole_program && dropped)
+        fprintf(diag_out(), "whole-program: dropped %d of %d units\n", dropped, cc->st.num_units);
+}
+
+static void emit_push(void) { emit("str x0, [sp, #-16]!"); }
+static void emit_pop(void) { emit("ldr x1, [sp], #16"); }
+
+static void emit_prologue(const char *name, int size, int is_global) {
+    if (is_global) emit_raw(".global _%s", name);
+    emit_raw("_%s:", name);
+    emit("stp x29, x30, [sp, #-16]!");
+    emit("mov x29, sp");
+    if (size > 0) {
+        size = (size + 15) & ~15;
+        emit("sub sp, sp, #%d", size);
+    }
+}
+
+static void emit_epilogue(int size) {
+    if (size > 0) {
+        size = (size + 15) & ~15;
+        emit("add sp, sp, #%d", size);
+    }
+    emit("ldp x29, x30, [sp], #16");
+    emit("ret");
+}
+
+static void emit_load_local(int off) { emit("ldr x0, [x29, #-%d]", off); }
+static void emit_store_local(int off) { emit("str x0, [x29, #-%d]", off); }
+static void emit_load_global(const char *n) {
+    add_ref(n);
+    emit("adrp x0, _%s@PAGE", n);
+    emit("add x0, x0, _%s@PAGEOFF", n);
+}
+static void emit_deref(int sz) {
+    if (sz == 1) emit("ldrb w0, [x0]");
+    else if (sz == 2) emit("ldrh w0, [x0]");
+    else if (sz == 4) emit("ldr w0, [x0]");
+    else emit("ldr x0, [x0]");
+}
+static void emit_store(int sz) {
+    if (sz == 1) emit("strb w1, [x0]");
+    else if (sz == 2) emit("strh w1, [x0]");
+    else if (sz == 4) emit("str w1, [x0]");
+    else emit("str x1, [x0]");
+}
+
+/* ============================================
+ * Expression Parsing
+ * ============================================ */
+
+static struct type *parse_expr(void);
+static struct type *parse_assign(void);
+static struct type *parse_ternary(void);
+static struct type *parse_logor(void);
+static struct type *parse_logand(void);
+static struct type *parse_bitor(void);
+static struct type *parse_bitxor(void);
+static struct type *parse_bitand(void);
+static struct type *parse_equality(void);
+static struct type *parse_relational(void);
+static struct type *parse_shift(void);
+static struct type *parse_additive(void);
+static struct type *parse_multiplicative(void);
+static struct type *parse_unary(void);
+static struct type *parse_postfix(void);
+static struct type *parse_primary(void);
+
+static struct type *parse_expr(void) {
+    struct type *t = parse_assign();
+    while (token == TK_COMMA) {
+        next_token();
+        t = parse_assign();
+    }
+    return t;
+}
+
+static struct type *parse_assign(void) {
+    return parse_ternary();
+}
+
+static struct type *parse_ternary(void) {
+    struct type *t = parse_logor();
+    if (token == TK_QUEST) {
+        next_token();
+        int l1 = new_label(), l2 = new_label();
+        emit_cond_jump(0, l1);
+        parse_expr();
+        expect(TK_COLON);
+        emit_jump(l2);
+        emit_label(l1);
+        t = parse_ternary();
+        emit_label(l2);
+    }
+    return t;
 }
 
 static struct type *parse_logor(void) {
@@ -905,10 +2118,10 @@ static struct type *parse_multiplicative(void) {
 }
 
 static struct type *parse_unary(void) {
-    if (token == TK_MINUS) { next_token(); parse_unary(); emit("neg x0, x0"); return type_int; }
+    if (token == TK_MINUS) { next_token(); parse_unary(); emit("neg x0, x0"); return cc->st.type_int; }
     if (token == TK_PLUS) { next_token(); return parse_unary(); }
-    if (token == TK_LNOT) { next_token(); parse_unary(); emit("cmp x0, #0"); emit("cset x0, eq"); return type_int; }
-    if (token == TK_TILDE) { next_token(); parse_unary(); emit("mvn x0, x0"); return type_int; }
+    if (token == TK_LNOT) { next_token(); parse_unary(); emit("cmp x0, #0"); emit("cset x0, eq"); return cc->st.type_int; }
+    if (token == TK_TILDE) { next_token(); parse_unary(); emit("mvn x0, x0"); return cc->st.type_int; }
     if (token == TK_STAR) {
         next_token();
         struct type *t = parse_unary();
@@ -917,7 +2130,7 @@ static struct type *parse_unary(void) {
             return t->base;
         }
         emit_deref(8);
-        return type_int;
+        return cc->st.type_int;
     }
     if (token == TK_AMP) {
         next_token();
@@ -927,7 +2140,7 @@ static struct type *parse_unary(void) {
         if (s->storage == SC_LOCAL || s->storage == SC_PARAM)
             emit("sub x0, x29, #%d", s->offset);
         else
-            emit_load_global(s->name);
+            emit_load_global(asm_name(s));
         next_token();
         return ptr_to(s->type);
     }
@@ -955,7 +2168,7 @@ static struct type *parse_unary(void) {
         while (token != TK_RPAREN && token != TK_EOF) next_token();
         expect(TK_RPAREN);
         emit_num(size);
-        return type_int;
+        return cc->st.type_int;
     }
     return parse_postfix();
 }
@@ -990,20 +2203,20 @@ static struct type *parse_primary(void) {
     if (token == TK_NUM) {
         emit_num(token_val);
         next_token();
-        return type_int;
+        return cc->st.type_int;
     }
     if (token == TK_CHAR) {
         emit_num(token_val);
         next_token();
-        return type_char;
+        return cc->st.type_char;
     }
     if (token == TK_STR) {
-        int idx = num_strings++;
-        strings[idx] = strdup(token_str);
+        int idx = add_string(token_str);
+        add_ref(string_name(idx));
         emit("adrp x0, _str%d@PAGE", idx);
         emit("add x0, x0, _str%d@PAGEOFF", idx);
         next_token();
-        return ptr_to(type_char);
+        return ptr_to(cc->st.type_char);
     }
     if (token == TK_IDENT) {
         char name[MAX_IDENT];
@@ -1021,8 +2234,12 @@ static struct type *parse_primary(void) {
             }
             expect(TK_RPAREN);
             for (int i = argc - 1; i >= 0; i--) emit("ldr x%d, [sp], #16", i);
-            emit("bl _%s", name);
-            return type_int;
+            struct symbol *f = find_symbol(name);
+            if (f && f->kind != SYM_FUNC) f = NULL;
+            const char *callee = f ? asm_name(f) : name;
+            add_ref(callee);
+            emit("bl _%s", callee);
+            return f ? f->type->base : cc->st.type_int;
         }
 
         struct symbol *s = find_symbol(name);
@@ -1035,7 +2252,7 @@ static struct type *parse_primary(void) {
                 emit_store_local(s->offset);
             else {
                 emit("mov x1, x0");
-                emit_load_global(s->name);
+                emit_load_global(asm_name(s));
                 emit_store(s->type->size);
             }
             return s->type;
@@ -1048,7 +2265,7 @@ static struct type *parse_primary(void) {
             emit_push();
             if (s->storage == SC_LOCAL || s->storage == SC_PARAM)
                 emit_load_local(s->offset);
-            else { emit_load_global(s->name); emit_deref(s->type->size); }
+            else { emit_load_global(asm_name(s)); emit_deref(s->type->size); }
             emit_pop();
             if (op == TK_PLUSEQ) emit("add x0, x0, x1");
             else if (op == TK_MINUSEQ) emit("sub x0, x0, x1");
@@ -1058,7 +2275,7 @@ static struct type *parse_primary(void) {
                 emit_store_local(s->offset);
             else {
                 emit("mov x1, x0");
-                emit_load_global(s->name);
+                emit_load_global(asm_name(s));
                 emit_store(s->type->size);
             }
             return s->type;
@@ -1089,12 +2306,12 @@ static struct type *parse_primary(void) {
                 if (s->storage == SC_LOCAL || s->storage == SC_PARAM)
                     emit("sub x0, x29, #%d", s->offset);
                 else
-                    emit_load_global(s->name);
+                    emit_load_global(asm_name(s));
             } else {
                 if (s->storage == SC_LOCAL || s->storage == SC_PARAM)
                     emit_load_local(s->offset);
                 else {
-                    emit_load_global(s->name);
+                    emit_load_global(asm_name(s));
                     emit_deref(8);
                 }
             }
@@ -1126,9 +2343,9 @@ static struct type *parse_primary(void) {
             else
                 emit_load_local(s->offset);
         } else {
-            emit_load_global(s->name);
-            if (s->type->kind != TYPE_ARRAY && s->type->kind != TYPE_FUNC)
-                emit_deref(s->type->size);
+            emit_load_global(asm_name(s));
+            if (s->type->kind == TYPE_FUNC) return ptr_to(s->type);
+            if (s->type->kind != TYPE_ARRAY) emit_deref(s->type->size);
         }
         return s->type;
     }
@@ -1139,7 +2356,350 @@ static struct type *parse_primary(void) {
         return t;
     }
     error("unexpected token: %d", token);
-    return type_int;
+    return cc->st.type_int;
+}
+
+/* ============================================
+ * Static Initializers
+ * ============================================ */
+
+/*
+ * Initializers are evaluated at compile time into a list of scalar items
+ * and emitted as data; nothing runs at startup. An item with a symbol is
+ * an address constant (&sym + val).
+ */
+
+static void add_init_item(int offset, int size, long val, const char *sym) {
+    if (cc->st.num_init_items >= cc->st.init_item_cap) {
+        cc->st.init_item_cap = cc->st.init_item_cap ? cc->st.init_item_cap * 2 : 64;
+        cc->st.init_items = realloc(cc->st.init_items, sizeof(struct init_item) * cc->st.init_item_cap);
+        if (!cc->st.init_items) error("out of memory");
+    }
+    struct init_item *it = &cc->st.init_items[cc->st.num_init_items];
+    it->offset = offset;
+    it->size = size;
+    it->val = val;
+    it->sym = sym ? strdup(sym) : NULL;
+    it->seq = cc->st.num_init_items++;
+    if (sym) add_ref(sym);
+}
+
+static void clear_init_items(void) {
+    for (int i = 0; i < cc->st.num_init_items; i++) free(cc->st.init_items[i].sym);
+    cc->st.num_init_items = 0;
+}
+
+static int init_is_zero(void) {
+    for (int i = 0; i < cc->st.num_init_items; i++)
+        if (cc->st.init_items[i].sym || cc->st.init_items[i].val) return 0;
+    return 1;
+}
+
+static int binop_prec(int tk) {
+    switch (tk) {
+        case TK_STAR: case TK_SLASH: case TK_MOD: return 10;
+        case TK_PLUS: case TK_MINUS: return 9;
+        case TK_LSHIFT: case TK_RSHIFT: return 8;
+        case TK_LT: case TK_GT: case TK_LE: case TK_GE: return 7;
+        case TK_EQ: case TK_NE: return 6;
+        case TK_AMP: return 5;
+        case TK_XOR: return 4;
+        case TK_OR: return 3;
+        case TK_LAND: return 2;
+        case TK_LOR: return 1;
+    }
+    return 0;
+}
+
+static long const_binop(int op, long a, long b) {
+    switch (op) {
+        case TK_STAR: return a * b;
+        case TK_SLASH: if (!b) error("division by zero"); return a / b;
+        case TK_MOD: if (!b) error("division by zero"); return a % b;
+        case TK_PLUS: return a + b;
+        case TK_MINUS: return a - b;
+        case TK_LSHIFT: return a << b;
+        case TK_RSHIFT: return a >> b;
+        case TK_LT: return a < b;
+        case TK_GT: return a > b;
+        case TK_LE: return a <= b;
+        case TK_GE: return a >= b;
+        case TK_EQ: return a == b;
+        case TK_NE: return a != b;
+        case TK_AMP: return a & b;
+        case TK_XOR: return a ^ b;
+        case TK_OR: return a | b;
+        case TK_LAND: return a && b;
+        default: return a || b;
+    }
+}
+
+static long parse_const_binary(int min_prec);
+
+static long parse_const_unary(void) {
+    long v;
+    if (token == TK_MINUS) { next_token(); return -parse_const_unary(); }
+    if (token == TK_PLUS) { next_token(); return parse_const_unary(); }
+    if (token == TK_TILDE) { next_token(); return ~parse_const_unary(); }
+    if (token == TK_LNOT) { next_token(); return !parse_const_unary(); }
+    if (token == TK_NUM || token == TK_CHAR) {
+        v = token_val;
+        next_token();
+        return v;
+    }
+    if (token == TK_LPAREN) {
+        next_token();
+        v = parse_const_binary(1);
+        expect(TK_RPAREN);
+        return v;
+    }
+    if (token == TK_IDENT) {
+        struct symbol *s = find_symbol(token_str);
+        if (!s || s->kind != SYM_ENUM_CONST)
+            error("initializer element is not constant: %s", token_str);
+        next_token();
+        return s->offset;
+    }
+    error("initializer element is not constant");
+    return 0;
+}
+
+static long parse_const_binary(int min_prec) {
+    long v = parse_const_unary();
+    int prec;
+    while ((prec = binop_prec(token)) >= min_prec) {
+        int op = token;
+        next_token();
+        v = const_binop(op, v, parse_const_binary(prec + 1));
+    }
+    return v;
+}
+
+static void parse_initializer(struct type *t, int offset);
+
+static long parse_const_expr_value(struct type *t) {
+    long v = parse_const_binary(1);
+    return (t->kind == TYPE_BOOL) ? (v != 0) : v;
+}
+
+static void parse_scalar_init(struct type *t, int offset) {
+    int braced = (token == TK_LBRACE);
+    if (braced) next_token();
+
+    if (token == TK_STR) {
+        add_init_item(offset, 8, 0, string_name(add_string(token_str)));
+        next_token();
+    } else if (token == TK_AMP || token == TK_IDENT) {
+        /* Address of a global, or an array/function name */
+        int amp = (token == TK_AMP);
+        if (amp) next_token();
+        struct symbol *s = (token == TK_IDENT) ? find_symbol(token_str) : NULL;
+        if (s && s->kind != SYM_ENUM_CONST) {
+            if (s->storage == SC_LOCAL || s->storage == SC_PARAM ||
+                (!amp && s->kind != SYM_FUNC && s->type->kind != TYPE_ARRAY))
+                error("initializer element is not constant: %s", token_str);
+            add_init_item(offset, 8, 0, asm_name(s));
+            next_token();
+        } else {
+            if (amp) error("expected identifier after &");
+            add_init_item(offset, t->size, parse_const_expr_value(t), NULL);
+        }
+    } else {
+        add_init_item(offset, t->size, parse_const_expr_value(t), NULL);
+    }
+
+    if (braced) {
+        if (token == TK_COMMA) next_token();
+        expect(TK_RBRACE);
+    }
+}
+
+/* Returns the number of elements initialized (for unsized arrays). */
+static int parse_array_init(struct type *t, int offset) {
+    struct type *et = t->base;
+    int idx = 0, count = 0;
+
+    if (token == TK_STR && et->size == 1) {
+        /* char s[] = "..." copies the bytes, including the NUL if it fits */
+        int len = (int)strlen(token_str) + 1;
+        if (t->array_size && len > t->array_size) len = t->array_size;
+        for (int i = 0; i < len; i++)
+            add_init_item(offset + i, 1, (unsigned char)token_str[i], NULL);
+        next_token();
+        return len;
+    }
+
+    expect(TK_LBRACE);
+    while (token != TK_RBRACE && token != TK_EOF) {
+        if (token == TK_LBRACKET) {
+            next_token();
+            idx = (int)parse_const_binary(1);
+            expect(TK_RBRACKET);
+            expect(TK_ASSIGN);
+        }
+        if (idx < 0 || (t->array_size && idx >= t->array_size))
+            error("array initializer index out of range");
+        parse_initializer(et, offset + idx * et->size);
+        if (++idx > count) count = idx;
+        if (token != TK_RBRACE) expect(TK_COMMA);
+    }
+    expect(TK_RBRACE);
+    return count;
+}
+
+static void parse_struct_init(struct type *t, int offset) {
+    int i = 0;
+    expect(TK_LBRACE);
+    while (token != TK_RBRACE && token != TK_EOF) {
+        if (token == TK_DOT) {
+            next_token();
+            if (token != TK_IDENT) error("expected member name");
+            for (i = 0; i < t->num_members; i++)
+                if (strcmp(t->members[i].name, token_str) == 0) break;
+            if (i == t->num_members) error("no member named %s", token_str);
+            next_token();
+            expect(TK_ASSIGN);
+        }
+        if (i >= t->num_members) error("excess elements in initializer");
+        parse_initializer(t->members[i].type, offset + t->members[i].offset);
+        /* A union initializes one member only */
+        i = (t->kind == TYPE_UNION) ? t->num_members : i + 1;
+        if (token != TK_RBRACE) expect(TK_COMMA);
+    }
+    expect(TK_RBRACE);
+}
+
+static void parse_initializer(struct type *t, int offset) {
+    if (t->kind == TYPE_ARRAY) parse_array_init(t, offset);
+    else if (t->kind == TYPE_STRUCT || t->kind == TYPE_UNION) parse_struct_init(t, offset);
+    else parse_scalar_init(t, offset);
+}
+
+/* Parse "= initializer" for an object; completes unsized array types. */
+static void parse_object_init(struct type **t) {
+    clear_init_items();
+    if ((*t)->kind == TYPE_ARRAY) {
+        int n = parse_array_init(*t, 0);
+        if (!(*t)->array_size) *t = array_of((*t)->base, n);
+    } else {
+        parse_initializer(*t, 0);
+    }
+}
+
+static int cmp_init_item(const void *a, const void *b) {
+    const struct init_item *x = a, *y = b;
+    if (x->offset != y->offset) return x->offset < y->offset ? -1 : 1;
+    return x->seq < y->seq ? -1 : 1;
+}
+
+static void emit_init_items(int size) {
+    static const char *dir[] = { "", ".byte", ".short", "", ".long", "", "", "", ".quad" };
+    int pos = 0, bytes = 0;
+    qsort(cc->st.init_items, cc->st.num_init_items, sizeof(struct init_item), cmp_init_item);
+    for (int i = 0; i < cc->st.num_init_items; i++) {
+        struct init_item *it = &cc->st.init_items[i];
+        if (i + 1 < cc->st.num_init_items && cc->st.init_items[i + 1].offset == it->offset) continue;
+        if (it->offset < pos) continue;  /* Overlaps an earlier member */
+        /* Runs of bytes (char arrays) are packed 16 to a line */
+        if (bytes && (it->size != 1 || it->offset != pos || bytes == 16)) {
+            fprintf(cc->st.output_file, "\n");
+            bytes = 0;
+        }
+        if (it->offset > pos) emit_raw("    .space %d", it->offset - pos);
+        if (it->sym && it->val) emit_raw("    .quad _%s + %ld", it->sym, it->val);
+        else if (it->sym) emit_raw("    .quad _%s", it->sym);
+        else if (it->size == 1) {
+            fprintf(cc->st.output_file, bytes ? ", %ld" : "    .byte %ld", it->val);
+            bytes++;
+        } else emit_raw("    %s %ld", dir[it->size], it->val);
+        pos = it->offset + it->size;
+    }
+    if (bytes) fprintf(cc->st.output_file, "\n");
+    if (pos < size) emit_raw("    .space %d", size - pos);
+}
+
+/*
+ * Zero objects go in __DATA,__bss via .zerofill so they take no file
+ * space. Const data goes in __TEXT,__const, shared between processes,
+ * or __DATA,__const when it holds addresses the loader must fix up.
+ */
+static void emit_object(const char *name, int size, int align, int is_const, int is_global) {
+    int p2 = 0;
+    while ((1 << p2) < align) p2++;
+    if (is_global) emit_raw(".global _%s", name);
+    if (!is_const && init_is_zero()) {
+        emit_raw(".zerofill __DATA,__bss,_%s,%d,%d", name, size, p2);
+        return;
+    }
+    int relocs = 0;
+    for (int i = 0; i < cc->st.num_init_items; i++)
+        if (cc->st.init_items[i].sym) relocs = 1;
+    if (!is_const) emit_raw(".data");
+    else if (relocs) emit_raw(".section __DATA,__const");
+    else emit_raw(".const");
+    emit_raw(".p2align %d", p2);
+    emit_raw("_%s:", name);
+    emit_init_items(size);
+    emit_raw(".text");
+}
+
+/* Copy size bytes from x1 to x0, or zero them when src is 0. */
+static void emit_block_copy(int size, int src) {
+    int blocks = size / 16;
+    if (blocks > 8) {
+        int l = new_label();
+        emit("mov x2, #%d", blocks);
+        emit_label(l);
+        if (src) emit("ldp x3, x4, [x1], #16");
+        emit("stp %s, %s, [x0], #16", src ? "x3" : "xzr", src ? "x4" : "xzr");
+        emit("subs x2, x2, #1");
+        emit_branch("b.ne", l);
+    } else {
+        for (int i = 0; i < blocks; i++) {
+            if (src) emit("ldp x3, x4, [x1], #16");
+            emit("stp %s, %s, [x0], #16", src ? "x3" : "xzr", src ? "x4" : "xzr");
+        }
+    }
+    size %= 16;
+    if (size >= 8) {
+        if (src) emit("ldr x3, [x1], #8");
+        emit("str %s, [x0], #8", src ? "x3" : "xzr");
+        size -= 8;
+    }
+    if (size >= 4) {
+        if (src) emit("ldr w3, [x1], #4");
+        emit("str %s, [x0], #4", src ? "w3" : "wzr");
+        size -= 4;
+    }
+    if (size >= 2) {
+        if (src) emit("ldrh w3, [x1], #2");
+        emit("strh %s, [x0], #2", src ? "w3" : "wzr");
+        size -= 2;
+    }
+    if (size >= 1) {
+        if (src) emit("ldrb w3, [x1], #1");
+        emit("strb %s, [x0], #1", src ? "w3" : "wzr");
+    }
+}
+
+/* Initialize a local array with a block copy from a read-only template. */
+static void emit_local_init(struct symbol *s) {
+    if (!cc->st.reachable) return;
+    int size = s->type->size;
+    int zero = init_is_zero();
+    if (!zero) {
+        char name[32];
+        snprintf(name, sizeof(name), "__tmpl%d", cc->st.num_templates++);
+        FILE *saved = begin_capture();
+        emit_object(name, size, s->type->align, 1, 0);
+        char *text = end_capture(saved);
+        cc->st.units[add_unit(name, NULL)].text = text;
+        add_ref(name);
+        emit("adrp x1, _%s@PAGE", name);
+        emit("add x1, x1, _%s@PAGEOFF", name);
+    }
+    emit("sub x0, x29, #%d", s->offset);
+    emit_block_copy(size, !zero);
 }
 
 /* ============================================
@@ -1155,10 +2715,10 @@ static void parse_stmt(void) {
     if (token == TK_IF) {
         next_token(); expect(TK_LPAREN); parse_expr(); expect(TK_RPAREN);
         int l1 = new_label(), l2 = new_label();
-        emit("cbz x0, L%d", l1);
+        emit_cond_jump(0, l1);
         parse_stmt();
         if (token == TK_ELSE) {
-            emit("b L%d", l2);
+            emit_jump(l2);
             emit_label(l1);
             next_token();
             parse_stmt();
@@ -1170,15 +2730,15 @@ static void parse_stmt(void) {
     if (token == TK_WHILE) {
         next_token();
         int l1 = new_label(), l2 = new_label();
-        int sb = break_label, sc = continue_label;
-        break_label = l2; continue_label = l1;
+        int sb = cc->st.break_label, sc = cc->st.continue_label;
+        cc->st.break_label = l2; cc->st.continue_label = l1;
         emit_label(l1);
         expect(TK_LPAREN); parse_expr(); expect(TK_RPAREN);
-        emit("cbz x0, L%d", l2);
+        emit_cond_jump(0, l2);
         parse_stmt();
-        emit("b L%d", l1);
+        emit_jump(l1);
         emit_label(l2);
-        break_label = sb; continue_label = sc;
+        cc->st.break_label = sb; cc->st.continue_label = sc;
         return;
     }
 
@@ -1187,10 +2747,10 @@ static void parse_stmt(void) {
         /* C99: for-loop can have declaration in init */
         if (token == TK_INT || token == TK_CHAR_KW || token == TK_LONG ||
             token == TK_SHORT || token == TK_BOOL) {
-            struct type *base = type_int;
-            if (token == TK_CHAR_KW) base = type_char;
-            else if (token == TK_LONG) base = type_long;
-            else if (token == TK_BOOL) base = type_bool;
+            struct type *base = cc->st.type_int;
+            if (token == TK_CHAR_KW) base = cc->st.type_char;
+            else if (token == TK_LONG) base = cc->st.type_long;
+            else if (token == TK_BOOL) base = cc->st.type_bool;
             next_token();
             while (token == TK_STAR) { base = ptr_to(base); next_token(); }
             if (token == TK_IDENT) {
@@ -1207,48 +2767,52 @@ static void parse_stmt(void) {
         }
         expect(TK_SEMI);
         int l1 = new_label(), l2 = new_label(), l3 = new_label();
-        int sb = break_label, sc = continue_label;
-        break_label = l2; continue_label = l3;
+        int sb = cc->st.break_label, sc = cc->st.continue_label;
+        cc->st.break_label = l2; cc->st.continue_label = l3;
         emit_label(l1);
-        if (token != TK_SEMI) { parse_expr(); emit("cbz x0, L%d", l2); }
+        if (token != TK_SEMI) { parse_expr(); emit_cond_jump(0, l2); }
         expect(TK_SEMI);
 
         /* Save update expression */
-        FILE *tmp = tmpfile();
-        FILE *old = output_file;
-        output_file = tmp;
+        flush_pending();
+        FILE *tmp = open_temp();
+        FILE *old = cc->st.output_file;
+        cc->st.output_file = tmp;
         if (token != TK_RPAREN) parse_expr();
-        output_file = old;
+        flush_pending();
+        cc->st.output_file = old;
         expect(TK_RPAREN);
 
         parse_stmt();
         emit_label(l3);
 
-        /* Emit update */
-        rewind(tmp);
-        char buf[4096];
-        size_t n;
-        while ((n = fread(buf, 1, sizeof(buf), tmp)) > 0)
-            fwrite(buf, 1, n, output_file);
-        fclose(tmp);
+        /* Emit update (dropped when the loop never gets here) */
+        if (cc->st.reachable) {
+            rewind(tmp);
+            char buf[4096];
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), tmp)) > 0)
+                fwrite(buf, 1, n, cc->st.output_file);
+        }
+        close_temp(tmp);
 
-        emit("b L%d", l1);
+        emit_jump(l1);
         emit_label(l2);
-        break_label = sb; continue_label = sc;
+        cc->st.break_label = sb; cc->st.continue_label = sc;
         return;
     }
 
     if (token == TK_DO) {
         next_token();
         int l1 = new_label(), l2 = new_label();
-        int sb = break_label, sc = continue_label;
-        break_label = l2; continue_label = l1;
+        int sb = cc->st.break_label, sc = cc->st.continue_label;
+        cc->st.break_label = l2; cc->st.continue_label = l1;
         emit_label(l1);
         parse_stmt();
         expect(TK_WHILE); expect(TK_LPAREN); parse_expr(); expect(TK_RPAREN); expect(TK_SEMI);
-        emit("cbnz x0, L%d", l1);
+        emit_cond_jump(1, l1);
         emit_label(l2);
-        break_label = sb; continue_label = sc;
+        cc->st.break_label = sb; cc->st.continue_label = sc;
         return;
     }
 
@@ -1256,9 +2820,9 @@ static void parse_stmt(void) {
         next_token(); expect(TK_LPAREN); parse_expr(); expect(TK_RPAREN);
         emit_push();
         int end = new_label();
-        int sb = break_label;
-        break_label = end;
-        switch_default = -1;
+        int sb = cc->st.break_label;
+        cc->st.break_label = end;
+        cc->st.switch_default = -1;
         expect(TK_LBRACE);
         while (token != TK_RBRACE && token != TK_EOF) {
             if (token == TK_CASE) {
@@ -1270,14 +2834,14 @@ static void parse_stmt(void) {
                 emit("ldr x1, [sp]");
                 emit_num(val);
                 emit("cmp x1, x0");
-                emit("b.ne L%d", l);
+                emit_branch("b.ne", l);
                 while (token != TK_CASE && token != TK_DEFAULT && token != TK_RBRACE && token != TK_EOF)
                     parse_stmt();
                 emit_label(l);
             } else if (token == TK_DEFAULT) {
                 next_token(); expect(TK_COLON);
-                switch_default = new_label();
-                emit_label(switch_default);
+                cc->st.switch_default = new_label();
+                emit_label(cc->st.switch_default);
                 while (token != TK_CASE && token != TK_DEFAULT && token != TK_RBRACE && token != TK_EOF)
                     parse_stmt();
             } else {
@@ -1287,30 +2851,31 @@ static void parse_stmt(void) {
         expect(TK_RBRACE);
         emit_label(end);
         emit("add sp, sp, #16");
-        break_label = sb;
+        cc->st.break_label = sb;
         return;
     }
 
     if (token == TK_RETURN) {
         next_token();
         if (token != TK_SEMI) parse_expr();
-        emit_epilogue(current_frame_size);
+        emit_epilogue(cc->st.current_frame_size);
+        cc->st.reachable = 0;
         expect(TK_SEMI);
         return;
     }
 
     if (token == TK_BREAK) {
         next_token();
-        if (break_label < 0) error("break outside loop/switch");
-        emit("b L%d", break_label);
+        if (cc->st.break_label < 0) error("break outside loop/switch");
+        emit_jump(cc->st.break_label);
         expect(TK_SEMI);
         return;
     }
 
     if (token == TK_CONTINUE) {
         next_token();
-        if (continue_label < 0) error("continue outside loop");
-        emit("b L%d", continue_label);
+        if (cc->st.continue_label < 0) error("continue outside loop");
+        emit_jump(cc->st.continue_label);
         expect(TK_SEMI);
         return;
     }
@@ -1319,6 +2884,7 @@ static void parse_stmt(void) {
         next_token();
         if (token != TK_IDENT) error("expected label");
         emit("b _L_%s", token_str);
+        cc->st.reachable = 0;
         next_token();
         expect(TK_SEMI);
         return;
@@ -1329,10 +2895,10 @@ static void parse_stmt(void) {
         token == TK_SHORT || token == TK_VOID || token == TK_UNSIGNED ||
         token == TK_SIGNED || token == TK_STRUCT || token == TK_UNION ||
         token == TK_ENUM || token == TK_BOOL) {
-        struct type *base = type_int;
-        if (token == TK_CHAR_KW) base = type_char;
-        else if (token == TK_LONG) base = type_long;
-        else if (token == TK_BOOL) base = type_bool;
+        struct type *base = cc->st.type_int;
+        if (token == TK_CHAR_KW) base = cc->st.type_char;
+        else if (token == TK_LONG) base = cc->st.type_long;
+        else if (token == TK_BOOL) base = cc->st.type_bool;
         next_token();
 
         while (token == TK_STAR) { base = ptr_to(base); next_token(); }
@@ -1343,14 +2909,21 @@ static void parse_stmt(void) {
 
         if (token == TK_LBRACKET) {
             next_token();
-            int size = (token == TK_NUM) ? (int)token_val : 1;
+            int size = (token == TK_NUM) ? (int)token_val : 0;
             if (token == TK_NUM) next_token();
             expect(TK_RBRACKET);
             s->type = array_of(base, size);
-            int bytes = size * base->size;
-            bytes = (bytes + 7) & ~7;
-            local_offset += bytes - 8;
-            s->offset = local_offset;
+            int has_init = (token == TK_ASSIGN);
+            if (has_init) {
+                next_token();
+                parse_object_init(&s->type);
+            } else if (!size) {
+                s->type = array_of(base, 1);
+            }
+            int bytes = (s->type->size + 7) & ~7;
+            cc->st.local_offset += bytes - 8;
+            s->offset = cc->st.local_offset;
+            if (has_init) emit_local_init(s);
         }
 
         if (token == TK_ASSIGN) {
@@ -1386,20 +2959,21 @@ static void parse_block(void) {
  * Declaration Parsing
  * ============================================ */
 
-static void parse_function(const char *name, struct type *ret) {
-    add_symbol(name, SYM_FUNC, SC_GLOBAL, ret);
-    num_locals = 0;
-    local_offset = 0;
-    num_labels = 0;
+static void parse_function(const char *name, struct type *ret, int is_static) {
+    struct type *ptypes[MAX_LOCALS];
+    cc->st.num_locals = 0;
+    cc->st.local_offset = 0;
+    cc->st.num_labels = 0;
 
     expect(TK_LPAREN);
-    int nparams = 0;
+    int nparams = token == TK_RPAREN ? -1 : 0;
     while (token != TK_RPAREN && token != TK_EOF) {
         if (nparams > 0) expect(TK_COMMA);
-        struct type *ptype = type_int;
-        if (token == TK_CHAR_KW) ptype = type_char;
-        else if (token == TK_LONG) ptype = type_long;
-        else if (token == TK_BOOL) ptype = type_bool;
+        if (nparams >= MAX_LOCALS) error("too many parameters");
+        struct type *ptype = cc->st.type_int;
+        if (token == TK_CHAR_KW) ptype = cc->st.type_char;
+        else if (token == TK_LONG) ptype = cc->st.type_long;
+        else if (token == TK_BOOL) ptype = cc->st.type_bool;
         if (token == TK_VOID && nparams == 0) { next_token(); break; }
         next_token();
         while (token == TK_STAR) { ptype = ptr_to(ptype); next_token(); }
@@ -1407,32 +2981,51 @@ static void parse_function(const char *name, struct type *ret) {
             add_symbol(token_str, SYM_VAR, SC_PARAM, ptype);
             next_token();
         }
-        nparams++;
+        ptypes[nparams++] = ptype;
     }
     expect(TK_RPAREN);
 
+    struct type *ftype = func_type(ret, ptypes, nparams);
+    struct symbol *prev = find_symbol(name);
+    if (prev && prev->kind == SYM_FUNC && prev->type != ftype &&
+        (prev->type->base != ret || (prev->type->array_size >= 0 && nparams >= 0)))
+        warn("conflicting types for %s", name);
+    struct symbol *fn = add_file_symbol(name, SYM_FUNC, is_static, ftype);
+    const char *label = asm_name(fn);
+
     if (token == TK_SEMI) { next_token(); return; }
 
-    current_frame_size = 256;
-    emit_prologue(name, current_frame_size);
+    cc->st.current_frame_size = 256;
+    begin_unit(label);
+    cc->st.reachable = 1;
+    emit_prologue(label, cc->st.current_frame_size, fn->storage != SC_STATIC);
     for (int i = 0; i < nparams && i < 8; i++)
-        emit("str x%d, [x29, #-%d]", i, locals[i].offset);
+        emit("str x%d, [x29, #-%d]", i, cc->st.locals[i].offset);
 
     parse_block();
 
+    /* Implicit return 0, only if control can fall off the end */
     emit_num(0);
-    emit_epilogue(current_frame_size);
-    num_locals = 0;
-    local_offset = 0;
+    emit_epilogue(cc->st.current_frame_size);
+    end_unit();
+    cc->st.reachable = 1;
+    cc->st.num_locals = 0;
+    cc->st.local_offset = 0;
 }
 
 static void parse_global(void) {
-    struct type *base = type_int;
+    struct type *base = cc->st.type_int;
     int is_typedef = 0;
 
     if (token == TK_TYPEDEF) { is_typedef = 1; next_token(); }
-    if (token == TK_STATIC || token == TK_EXTERN || token == TK_INLINE) next_token();
-    if (token == TK_INLINE) next_token();  /* C99: inline can appear with other specifiers */
+    int is_const = 0, is_static = 0;
+    /* C99: specifiers and qualifiers can appear in any order */
+    while (token == TK_STATIC || token == TK_EXTERN || token == TK_INLINE ||
+           token == TK_CONST) {
+        if (token == TK_CONST) is_const = 1;
+        if (token == TK_STATIC) is_static = 1;
+        next_token();
+    }
 
     if (token == TK_STRUCT || token == TK_UNION) {
         int is_union = (token == TK_UNION);
@@ -1449,10 +3042,10 @@ static void parse_global(void) {
             next_token();
             int offset = 0;
             while (token != TK_RBRACE && token != TK_EOF) {
-                struct type *mtype = type_int;
-                if (token == TK_CHAR_KW) mtype = type_char;
-                else if (token == TK_LONG) mtype = type_long;
-                else if (token == TK_BOOL) mtype = type_bool;
+                struct type *mtype = cc->st.type_int;
+                if (token == TK_CHAR_KW) mtype = cc->st.type_char;
+                else if (token == TK_LONG) mtype = cc->st.type_long;
+                else if (token == TK_BOOL) mtype = cc->st.type_bool;
                 next_token();
                 while (token == TK_STAR) { mtype = ptr_to(mtype); next_token(); }
                 if (token == TK_IDENT) {
@@ -1469,7 +3062,7 @@ static void parse_global(void) {
             expect(TK_RBRACE);
         } else if (tag[0]) {
             base = find_tag(tag);
-            if (!base) base = type_int;
+            if (!base) base = cc->st.type_int;
         }
     } else if (token == TK_ENUM) {
         next_token();
@@ -1479,7 +3072,7 @@ static void parse_global(void) {
             int val = 0;
             while (token != TK_RBRACE && token != TK_EOF) {
                 if (token == TK_IDENT) {
-                    struct symbol *s = add_symbol(token_str, SYM_ENUM_CONST, SC_GLOBAL, type_int);
+                    struct symbol *s = add_symbol(token_str, SYM_ENUM_CONST, SC_GLOBAL, cc->st.type_int);
                     next_token();
                     if (token == TK_ASSIGN) {
                         next_token();
@@ -1496,17 +3089,25 @@ static void parse_global(void) {
             }
             expect(TK_RBRACE);
         }
-        base = type_int;
+        base = cc->st.type_int;
     } else {
-        if (token == TK_VOID) base = type_void;
-        else if (token == TK_CHAR_KW) base = type_char;
-        else if (token == TK_LONG) base = type_long;
-        else if (token == TK_SHORT) base = new_type(TYPE_SHORT, 2, 2);
-        else if (token == TK_BOOL) base = type_bool;
+        if (token == TK_VOID) base = cc->st.type_void;
+        else if (token == TK_CHAR_KW) base = cc->st.type_char;
+        else if (token == TK_LONG) base = cc->st.type_long;
+        else if (token == TK_SHORT) base = cc->st.type_short;
+        else if (token == TK_BOOL) base = cc->st.type_bool;
         next_token();
     }
 
-    while (token == TK_STAR) { base = ptr_to(base); next_token(); }
+    /* The object is const only if no * follows the const: const char *p
+     * points at const chars, char *const p is itself const */
+    while (token == TK_CONST) { is_const = 1; next_token(); }
+    while (token == TK_STAR) {
+        base = ptr_to(base);
+        is_const = 0;
+        next_token();
+        while (token == TK_CONST) { is_const = 1; next_token(); }
+    }
 
     if (token == TK_SEMI) { next_token(); return; }
     if (token != TK_IDENT) return;
@@ -1522,27 +3123,31 @@ static void parse_global(void) {
     }
 
     if (token == TK_LPAREN) {
-        parse_function(name, base);
+        parse_function(name, base, is_static);
         return;
     }
 
     /* Global variable */
-    struct symbol *s = add_symbol(name, SYM_VAR, SC_GLOBAL, base);
-    int size = base->size;
+    struct symbol *s = add_file_symbol(name, SYM_VAR, is_static, base);
     if (token == TK_LBRACKET) {
         next_token();
-        int asz = (token == TK_NUM) ? (int)token_val : 1;
+        int asz = (token == TK_NUM) ? (int)token_val : 0;
         if (token == TK_NUM) next_token();
         expect(TK_RBRACKET);
         s->type = array_of(base, asz);
-        size = asz * base->size;
     }
 
-    emit_raw(".data");
-    emit_raw(".global _%s", name);
-    emit_raw("_%s:", name);
-    emit_raw("    .space %d", size);
-    emit_raw(".text");
+    begin_unit(asm_name(s));
+    clear_init_items();
+    if (token == TK_ASSIGN) {
+        next_token();
+        parse_object_init(&s->type);
+    } else if (s->type->kind == TYPE_ARRAY && !s->type->array_size) {
+        s->type = array_of(base, 1);
+    }
+    emit_object(asm_name(s), s->type->size, s->type->align, is_const,
+                s->storage != SC_STATIC);
+    end_unit();
     expect(TK_SEMI);
 }
 
@@ -1550,42 +3155,780 @@ static void parse_global(void) {
  * Main
  * ============================================ */
 
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s input.c [-o output.s]\n", argv[0]);
-        return 1;
-    }
+/* Takes ownership of buf */
+static void start_input(const char *name, char *buf, long len) {
+    cc->st.input_bufs[0] = buf;
+    cc->st.input_len[0] = len;
+    cc->st.input_pos[0] = 0;
+    cc->st.input_names[0] = name;
+    cc->st.input_lines[0] = 1;
+    cc->st.input_depth = 0;
+    next_char();
+}
 
-    input_files[0] = fopen(argv[1], "r");
-    if (!input_files[0]) { fprintf(stderr, "Cannot open: %s\n", argv[1]); return 1; }
-    input_names[0] = argv[1];
-    input_lines[0] = 1;
+static void compile_buffer(const char *name, char *buf, long len) {
+    start_input(name, buf, len);
+    if (cc->pipeline) start_lexer();
+    next_token();
+    while (token != TK_EOF) parse_global();
+    if (cc->pipeline) stop_lexer(0);
+    free(cc->st.input_bufs[0]);
+    cc->st.input_bufs[0] = NULL;
+    end_file_scope();
+}
 
-    const char *outname = "a.s";
-    for (int i = 2; i < argc - 1; i++)
-        if (strcmp(argv[i], "-o") == 0) outname = argv[i + 1];
+/* ============================================
+ * Library Interface
+ * ============================================ */
 
-    output_file = fopen(outname, "w");
-    if (!output_file) { fprintf(stderr, "Cannot create: %s\n", outname); return 1; }
+static pthread_once_t char_class_once = PTHREAD_ONCE_INIT;
 
+static void reset_state(void) {
+    memset(&cc->st, 0, sizeof(cc->st));
+    cc->st.reachable = 1;
+    cc->st.pending_jump = -1;
+    cc->st.break_label = cc->st.continue_label = cc->st.switch_default = -1;
+    cc->st.current_unit = -1;
     init_types();
-    next_char();
-    next_token();
+}
 
-    emit_raw(".text");
-    emit_raw(".align 4");
+static void free_macros(void) {
+    for (int i = 0; i < cc->st.num_macros; i++) free(cc->st.macros[i].body);
+    cc->st.num_macros = 0;
+}
 
-    while (token != TK_EOF) parse_global();
+/* Release everything a compilation allocated, finished or not */
+static void free_state(void) {
+    if (cc->st.lexer_running) stop_lexer(1);
+    for (int i = 0; i <= cc->st.input_depth && i < MAX_INCLUDE; i++) free(cc->st.input_bufs[i]);
+    free_str_chunks();
+    while (cc->st.num_temp_files > 0) close_temp(cc->st.temp_files[cc->st.num_temp_files - 1]);
+    while (cc->st.type_blocks) {
+        struct type_block *b = cc->st.type_blocks;
+        for (int i = 0; i < b->used; i++) {
+            free(b->types[i].members);
+            free(b->types[i].params);
+        }
+        cc->st.type_blocks = b->next;
+        b->next = cc->spare_types;
+        cc->spare_types = b;
+    }
+    free(cc->st.derived_index);
+    for (int i = 0; i < cc->st.num_strings; i++) free(cc->st.strings[i]);
+    free(cc->st.strings);
+    free(cc->st.string_index);
+    free_macros();
+    free(cc->st.label_refs);
+    free(cc->st.label_reached);
+    clear_init_items();
+    free(cc->st.init_items);
+    for (int i = 0; i < cc->st.num_units; i++) free(cc->st.units[i].text);
+    free(cc->st.units);
+    free(cc->st.unit_refs);
+}
+
+static void reset_options(struct sectorc *ctx) {
+    struct sectorc *outer = cc;
+    cc = ctx;
+    cc->whole_program = cc->show_stats = cc->pipeline = cc->peephole = 0;
+    cc->use_simd = 1;
+    cc->jobs = 1;
+    ctx->cache_dir[0] = '\0';
+    ctx->cache_limit = 256L << 20;
+    cc = outer;
+}
+
+struct sectorc *sectorc_new(void) {
+    struct sectorc *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) return NULL;
+    pthread_once(&char_class_once, init_char_class);
+    reset_options(ctx);
+    return ctx;
+}
+
+void sectorc_free(struct sectorc *ctx) {
+    while (ctx->spare_types) {
+        struct type_block *b = ctx->spare_types;
+        ctx->spare_types = b->next;
+        free(b);
+    }
+    for (int i = 0; i < ctx->num_sources; i++) {
+        free(ctx->sources[i].path);
+        free(ctx->sources[i].text);
+    }
+    free(ctx->sources);
+    free(ctx);
+}
+
+void sectorc_set_diag(struct sectorc *ctx, FILE *diag) {
+    ctx->diag = diag;
+}
 
-    if (num_strings > 0) {
-        emit_raw(".data");
-        for (int i = 0; i < num_strings; i++) {
-            emit_raw("_str%d:", i);
-            emit_raw("    .asciz \"%s\"", strings[i]);
+int sectorc_option(struct sectorc *ctx, const char *opt) {
+    struct sectorc *outer = cc;
+    int known = 1;
+    cc = ctx;
+    if (strcmp(opt, "--whole-program") == 0) cc->whole_program = 1;
+    else if (strcmp(opt, "--stats") == 0) cc->show_stats = 1;
+    else if (strcmp(opt, "--simd") == 0) cc->use_simd = 1;
+    else if (strcmp(opt, "--no-simd") == 0) cc->use_simd = 0;
+    else if (strcmp(opt, "--pipeline") == 0) cc->pipeline = 1;
+    else if (strcmp(opt, "--peephole") == 0) cc->peephole = 1;
+    else if (strncmp(opt, "--cache-dir=", 12) == 0)
+        snprintf(ctx->cache_dir, sizeof(ctx->cache_dir), "%s", opt + 12);
+    else if (strncmp(opt, "--cache-size=", 13) == 0) {
+        char *end;
+        ctx->cache_limit = strtol(opt + 13, &end, 10);
+        if (*end == 'K' || *end == 'k') ctx->cache_limit <<= 10;
+        if (*end == 'M' || *end == 'm') ctx->cache_limit <<= 20;
+        if (*end == 'G' || *end == 'g') ctx->cache_limit <<= 30;
+    }
+    else if (strncmp(opt, "-j", 2) == 0 && opt[2]) {
+        cc->jobs = atoi(opt + 2);
+        if (cc->jobs < 1) cc->jobs = 1;
+        if (cc->jobs > MAX_JOBS) cc->jobs = MAX_JOBS;
+    }
+    else known = 0;
+    cc = outer;
+    return known;
+}
+
+const char *sectorc_error(struct sectorc *ctx) {
+    return ctx->error;
+}
+
+/* ============================================
+ * Compile Cache
+ * ============================================ */
+
+/*
+ * With a cache directory set, the inputs are first run through the lexer
+ * alone and every token the parser would see (includes and macros
+ * already applied) is hashed with SHA-256, together with the compiler
+ * build and the flags that change code. The assembly is stored under
+ * that hash. Hits refresh the file's mtime; when the directory grows past
+ * the size limit the least recently used entries are removed. Results
+ * that came with warnings are not stored, so warnings are never lost.
+ */
+
+struct sha256 {
+    uint32_t h[8];
+    unsigned char buf[64];
+    uint64_t len;
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(struct sha256 *c, const unsigned char *p) {
+    uint32_t w[64], s[8];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | p[4 * i + 1] << 16 | p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(s, c->h, sizeof(s));
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = s[7] + (ROR32(s[4], 6) ^ ROR32(s[4], 11) ^ ROR32(s[4], 25)) +
+                      ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROR32(s[0], 2) ^ ROR32(s[0], 13) ^ ROR32(s[0], 22)) +
+                      ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(s + 1, s, sizeof(uint32_t) * 7);
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) c->h[i] += s[i];
+}
+
+static void sha256_init(struct sha256 *c) {
+    static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    memcpy(c->h, iv, sizeof(iv));
+    c->len = 0;
+}
+
+static void sha256_update(struct sha256 *c, const void *data, size_t len) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        size_t used = c->len % 64, n = 64 - used < len ? 64 - used : len;
+        memcpy(c->buf + used, p, n);
+        c->len += n;
+        p += n;
+        len -= n;
+        if (c->len % 64 == 0) sha256_block(c, c->buf);
+    }
+}
+
+static void sha256_hex(struct sha256 *c, char *hex) {
+    uint64_t bits = c->len * 8;
+    unsigned char pad = 0x80, len[8];
+    sha256_update(c, &pad, 1);
+    pad = 0;
+    while (c->len % 64 != 56) sha256_update(c, &pad, 1);
+    for (int i = 0; i < 8; i++) len[i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha256_update(c, len, 8);
+    for (int i = 0; i < 8; i++) sprintf(hex + 8 * i, "%08x", c->h[i]);
+}
+
+/* Hash what the parser would see; 0 if the lexer fails (no caching then) */
+static int cache_key(int n, const char **names, const char **srcs, const size_t *lens,
+                     char *key) {
+    struct sha256 h;
+    volatile int ok = 0;
+    sha256_init(&h);
+    sha256_update(&h, SECTORC_VERSION, sizeof(SECTORC_VERSION));
+    /* Every option that changes the output; the rest only change speed */
+    sha256_update(&h, cc->whole_program ? "W" : "-", 1);
+    sha256_update(&h, cc->peephole ? "P" : "-", 1);
+
+    reset_state();
+    cc->st.prelexing = 1;
+    cc->bail_set = 1;
+    if (setjmp(cc->bail) == 0) {
+        for (int i = 0; i < n; i++) {
+            char *buf = malloc(lens[i] + 1);
+            if (!buf) error("out of memory");
+            memcpy(buf, srcs[i], lens[i]);
+            buf[lens[i]] = '\0';
+            start_input(names[i], buf, (long)lens[i]);
+            do {
+                cc->st.lex_wrote_str = 0;
+                lex_token();
+                sha256_update(&h, &token, sizeof(token));
+                sha256_update(&h, &token_val, sizeof(token_val));
+                if (cc->st.lex_wrote_str) sha256_update(&h, token_str, strlen(token_str) + 1);
+            } while (token != TK_EOF);
+            free(cc->st.input_bufs[0]);
+            cc->st.input_bufs[0] = NULL;
+            end_file_scope();
+        }
+        ok = 1;
+    }
+    cc->bail_set = 0;
+    free_state();
+    if (ok) sha256_hex(&h, key);
+    return ok;
+}
+
+/* Counters live in <dir>/stats as "hits misses", updated under a lock */
+static void cache_count(int hit, long *hits, long *misses) {
+    char path[MAX_PATH + 16], buf[64] = {0};
+    long h = 0, m = 0;
+    snprintf(path, sizeof(path), "%s/stats", cc->cache_dir);
+    if (hit >= 0) mkdir(cc->cache_dir, 0755);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return;
+    flock(fd, LOCK_EX);
+    if (pread(fd, buf, sizeof(buf) - 1, 0) > 0) sscanf(buf, "%ld %ld", &h, &m);
+    if (hit > 0) h++;
+    if (hit == 0) m++;
+    if (hit >= 0) {
+        int len = snprintf(buf, sizeof(buf), "%ld %ld\n", h, m);
+        if (ftruncate(fd, 0) != 0 || pwrite(fd, buf, len, 0) != len) h = m = 0;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    if (hits) *hits = h;
+    if (misses) *misses = m;
+}
+
+static int cache_lookup(const char *key, sectorc_sink out, void *user) {
+    char path[MAX_PATH + 80];
+    snprintf(path, sizeof(path), "%s/%s.s", cc->cache_dir, key);
+    long len;
+    char *text = load_file(path, &len);
+    if (!text) return 0;
+    utimes(path, NULL);             /* Most recently used */
+    if (out) out(text, (size_t)len, user);
+    free(text);
+    return 1;
+}
+
+struct cache_entry {
+    char name[80];
+    time_t mtime;
+    off_t size;
+};
+
+static int cmp_cache_age(const void *a, const void *b) {
+    const struct cache_entry *x = a, *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/* Scan the cache; drop the oldest entries while over limit (< 0: never) */
+static void cache_scan(long limit, int *count, long *total) {
+    struct cache_entry *list = NULL;
+    int n = 0, cap = 0;
+    *count = 0;
+    *total = 0;
+    DIR *dir = opendir(cc->cache_dir);
+    if (!dir) return;
+    struct dirent *d;
+    while ((d = readdir(dir))) {
+        size_t len = strlen(d->d_name);
+        char path[MAX_PATH + 80];
+        struct stat st;
+        if (len != 66 || strcmp(d->d_name + 64, ".s") != 0) continue;
+        if (snprintf(path, sizeof(path), "%s/%s", cc->cache_dir, d->d_name) >= (int)sizeof(path))
+            continue;
+        if (stat(path, &st) != 0) continue;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            struct cache_entry *grown = realloc(list, sizeof(*list) * cap);
+            if (!grown) break;
+            list = grown;
+        }
+        strcpy(list[n].name, d->d_name);
+        list[n].mtime = st.st_mtime;
+        list[n].size = st.st_size;
+        *total += st.st_size;
+        n++;
+    }
+    closedir(dir);
+    if (limit >= 0 && *total > limit) {
+        qsort(list, n, sizeof(*list), cmp_cache_age);
+        for (int i = 0; i < n && *total > limit - limit / 10; i++) {
+            char path[MAX_PATH + 80];
+            snprintf(path, sizeof(path), "%s/%s", cc->cache_dir, list[i].name);
+            if (unlink(path) == 0) *total -= list[i].size;
+            list[i].size = -1;
+        }
+    }
+    for (int i = 0; i < n; i++) if (list[i].size >= 0) (*count)++;
+    free(list);
+}
+
+static void cache_store(const char *key, const char *text, size_t len) {
+    static _Atomic int seq;
+    char tmp[MAX_PATH + 80], path[MAX_PATH + 80];
+    int count;
+    long total;
+    snprintf(tmp, sizeof(tmp), "%s/.tmp.%d.%d", cc->cache_dir, (int)getpid(), atomic_fetch_add(&seq, 1));
+    snprintf(path, sizeof(path), "%s/%s.s", cc->cache_dir, key);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    int ok = fwrite(text, 1, len, f) == len;
+    if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) { unlink(tmp); return; }
+    cache_scan(cc->cache_limit, &count, &total);
+}
+
+#ifndef SECTORC_LIBRARY
+/* --cache-stats */
+static void report_cache(FILE *f) {
+    long hits = 0, misses = 0, total;
+    int count;
+    cache_count(-1, &hits, &misses);
+    cache_scan(-1, &count, &total);
+    fprintf(f, "cache %s: %ld hits, %ld misses, %d entries, %ld bytes (limit %ld)\n",
+            cc->cache_dir, hits, misses, count, total, cc->cache_limit);
+}
+#endif
+
+/* Compile srcs[] into one assembly file; each buffer is copied first. */
+static int compile_sources(struct sectorc *ctx, int n, const char **names,
+                           const char **srcs, const size_t *lens,
+                           sectorc_sink out, void *user) {
+    struct sectorc *outer = cc;
+    char *text = NULL;
+    size_t size = 0;
+    volatile int failed = 0;
+
+    cc = ctx;
+    ctx->error[0] = '\0';
+
+    char key[65];
+    int use_cache = ctx->cache_dir[0] && cache_key(n, names, srcs, lens, key);
+    if (use_cache && cache_lookup(key, out, user)) {
+        cache_count(1, NULL, NULL);
+        cc = outer;
+        return 0;
+    }
+    if (use_cache) cache_count(0, NULL, NULL);
+
+    reset_state();
+    FILE *stream = open_memstream(&text, &size);
+    if (!stream) { snprintf(ctx->error, sizeof(ctx->error), "cannot buffer output"); cc = outer; return 1; }
+    cc->st.output_file = stream;
+    cc->st.num_files = n;
+
+    ctx->bail_set = 1;
+    if (setjmp(ctx->bail) == 0) {
+        emit_raw(".text");
+        emit_raw(".align 4");
+        for (int i = 0; i < n; i++) {
+            char *buf = malloc(lens[i] + 1);
+            if (!buf) error("out of memory");
+            memcpy(buf, srcs[i], lens[i]);
+            buf[lens[i]] = '\0';
+            compile_buffer(names[i], buf, (long)lens[i]);
         }
+        emit_strings();
+        emit_units();
+        if (cc->show_stats) report_types();
+    } else {
+        failed = 1;
+    }
+    ctx->bail_set = 0;
+
+    fclose(stream);
+    if (!failed && out) out(text, size, user);
+    if (!failed && use_cache && !cc->st.num_warnings) cache_store(key, text, size);
+    free(text);
+    free_state();
+    cc = outer;
+    return failed;
+}
+
+int sectorc_compile(struct sectorc *ctx, const char *src, size_t len,
+                    sectorc_sink out, void *user) {
+    const char *name = "<input>";
+    return compile_sources(ctx, 1, &name, &src, &len, out, user);
+}
+
+#ifndef SECTORC_LIBRARY
+
+/* ============================================
+ * Main
+ * ============================================ */
+
+/* --lex-bench: tokenize the inputs repeatedly and report throughput */
+static int lex_bench(const char **names, char **bufs, long *lens, int num_inputs) {
+    enum { ROUNDS = 50 };
+    long bytes = 0, tokens = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < num_inputs; i++) {
+            char *buf = malloc(lens[i] + 1);
+            if (!buf) error("out of memory");
+            memcpy(buf, bufs[i], lens[i] + 1);
+            free_macros();
+            start_input(names[i], buf, lens[i]);
+            bytes += lens[i];
+            for (lex_token(); token != TK_EOF; lex_token()) tokens++;
+            free(cc->st.input_bufs[0]);
+            cc->st.input_bufs[0] = NULL;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("lex (%s): %ld tokens, %.1f MB/s\n", cc->use_simd ? "simd" : "scalar",
+           tokens / ROUNDS, bytes / secs / 1e6);
+    return 0;
+}
+
+struct command {
+    const char *inputs[MAX_INPUTS];
+    int num_inputs;
+    const char *outname;
+    int bench;
+    int cache_stats;
+};
+
+static const char usage[] =
+    "Usage: cc [--whole-program] [--stats] [--pipeline] [--peephole] [-j N] [--no-simd] "
+    "[--lex-bench] [--cache-dir=DIR] [--cache-size=N[KMG]] input.c... [-o output.s]\n"
+    "       cc --cache-stats --cache-dir=DIR\n"
+    "       cc --server SOCKET\n"
+    "       cc --client SOCKET <compile arguments>\n";
+
+/* Apply argv to ctx and cmd; 0 on success, otherwise diag gets the reason */
+static int parse_command(struct sectorc *ctx, int argc, char **argv,
+                         struct command *cmd, FILE *diag) {
+    char opt[32];
+    const char *env;
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->outname = "a.s";
+    if ((env = getenv("SECTORC_CACHE_DIR")) && *env) {
+        char dir[MAX_PATH + 16];
+        snprintf(dir, sizeof(dir), "--cache-dir=%s", env);
+        sectorc_option(ctx, dir);
+    }
+    if ((env = getenv("SECTORC_CACHE_SIZE")) && *env) {
+        char size[64];
+        snprintf(size, sizeof(size), "--cache-size=%s", env);
+        sectorc_option(ctx, size);
+    }
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) cmd->outname = argv[++i];
+        else if (strcmp(argv[i], "--lex-bench") == 0) cmd->bench = 1;
+        else if (strcmp(argv[i], "--cache-stats") == 0) cmd->cache_stats = 1;
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            snprintf(opt, sizeof(opt), "-j%s", argv[++i]);
+            sectorc_option(ctx, opt);
+        }
+        else if (sectorc_option(ctx, argv[i])) continue;
+        else if (cmd->num_inputs < MAX_INPUTS) cmd->inputs[cmd->num_inputs++] = argv[i];
+        else { fprintf(diag, "too many input files\n"); return 1; }
+    }
+    if (cmd->cache_stats && !ctx->cache_dir[0]) { fprintf(diag, "--cache-stats needs a cache directory\n"); return 1; }
+    if (cmd->num_inputs == 0 && !cmd->cache_stats) { fputs(usage, diag); return 1; }
+    /* Several inputs are linked into one output, so they form the program */
+    if (cmd->num_inputs > 1) sectorc_option(ctx, "--whole-program");
+    return 0;
+}
+
+/* Load the inputs and compile them into out(); returns the exit status */
+static int run_command(struct sectorc *ctx, struct command *cmd, FILE *diag,
+                       sectorc_sink out, void *user) {
+    char *bufs[MAX_INPUTS];
+    long lens[MAX_INPUTS];
+    size_t sizes[MAX_INPUTS];
+    int n = 0, status = 1;
+
+    sectorc_set_diag(ctx, diag);
+    if (cmd->cache_stats) {
+        cc = ctx;
+        report_cache(diag == stderr ? stdout : diag);
+        return 0;
+    }
+    for (; n < cmd->num_inputs; n++) {
+        bufs[n] = load_file(cmd->inputs[n], &lens[n]);
+        if (!bufs[n]) { fprintf(diag, "Cannot open: %s\n", cmd->inputs[n]); goto done; }
+        sizes[n] = (size_t)lens[n];
+    }
+    if (cmd->bench) {
+        cc = ctx;
+        reset_state();
+        status = lex_bench(cmd->inputs, bufs, lens, n);
+        free_state();
+    } else {
+        status = compile_sources(ctx, n, cmd->inputs, (const char **)bufs, sizes, out, user);
     }
+done:
+    for (int i = 0; i < n; i++) free(bufs[i]);
+    return status;
+}
+
+static void write_output(const char *data, size_t len, void *user) {
+    fwrite(data, 1, len, (FILE *)user);
+}
+
+/* ============================================
+ * Compile Server
+ * ============================================ */
+
+/*
+ * cc --server SOCKET keeps one context alive and serves compile requests
+ * on a Unix domain socket. What carries over is the text of every header
+ * read (see load_header) and the type blocks; each request still lexes
+ * its headers and rebuilds macros and types, since what a header expands
+ * to depends on the macros defined before it.
+ *
+ * cc --client SOCKET <args> sends its working directory and arguments,
+ * then writes back the assembly and diagnostics it receives and exits
+ * with the server's status. Requests are served one at a time.
+ *
+ * Every message is a frame: a type byte, a 4-byte length, the payload.
+ *   client: 'C' cwd, 'A' argument (repeated), 'E' end of request
+ *   server: 'O' assembly, 'D' diagnostics, 'X' exit status
+ */
 
-    fclose(input_files[0]);
-    fclose(output_file);
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
     return 0;
 }
+
+static int read_all(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int send_frame(int fd, int type, const void *data, size_t len) {
+    unsigned char head[5];
+    head[0] = (unsigned char)type;
+    for (int i = 0; i < 4; i++) head[1 + i] = (unsigned char)(len >> (8 * i));
+    if (write_all(fd, head, 5) < 0) return -1;
+    return write_all(fd, data, len);
+}
+
+/* The payload is NUL-terminated; the caller frees it */
+static int recv_frame(int fd, int *type, char **data, size_t *len) {
+    unsigned char head[5];
+    if (read_all(fd, head, 5) < 0) return -1;
+    *type = head[0];
+    *len = head[1] | head[2] << 8 | head[3] << 16 | (size_t)head[4] << 24;
+    if (!(*data = malloc(*len + 1))) return -1;
+    if (read_all(fd, *data, *len) < 0) { free(*data); return -1; }
+    (*data)[*len] = '\0';
+    return 0;
+}
+
+static int unix_socket(const char *path, struct sockaddr_un *addr) {
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) perror("socket");
+    return fd;
+}
+
+static void send_output(const char *data, size_t len, void *user) {
+    send_frame(*(int *)user, 'O', data, len);
+}
+
+static void serve_request(struct sectorc *ctx, int fd) {
+    char *args[MAX_INPUTS + 64];
+    int argc = 0, type, status = 1;
+    char *cwd = NULL, *data;
+    size_t len;
+
+    for (;;) {
+        if (recv_frame(fd, &type, &data, &len) < 0) goto done;
+        if (type == 'E') { free(data); break; }
+        if (type == 'C') { free(cwd); cwd = data; }
+        else if (type == 'A' && argc < (int)(sizeof(args) / sizeof(args[0]))) args[argc++] = data;
+        else free(data);
+    }
+
+    char *diag_text = NULL;
+    size_t diag_len = 0;
+    FILE *diag = open_memstream(&diag_text, &diag_len);
+    if (!diag) goto done;
+    struct command cmd;
+    reset_options(ctx);
+    if (!cwd || chdir(cwd) != 0) fprintf(diag, "cannot change to %s\n", cwd ? cwd : "(none)");
+    else if (parse_command(ctx, argc, args, &cmd, diag) == 0) {
+        if (cmd.bench) fprintf(diag, "--lex-bench is not available through the server\n");
+        else status = run_command(ctx, &cmd, diag, send_output, &fd);
+    }
+    if (cc->show_stats)
+        fprintf(diag, "server: %d cached headers, %ld hits, %ld misses\n",
+                ctx->num_sources, ctx->source_hits, ctx->source_misses);
+    sectorc_set_diag(ctx, NULL);    /* back to stderr before diag is closed */
+    fclose(diag);
+    send_frame(fd, 'D', diag_text, diag_len);
+    free(diag_text);
+    unsigned char code = (unsigned char)status;
+    send_frame(fd, 'X', &code, 1);
+done:
+    for (int i = 0; i < argc; i++) free(args[i]);
+    free(cwd);
+}
+
+static int run_server(const char *path) {
+    struct sockaddr_un addr;
+    int fd = unix_socket(path, &addr);
+    if (fd < 0) return 1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        perror(path);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sectorc *ctx = sectorc_new();
+    if (!ctx) { fprintf(stderr, "out of memory\n"); return 1; }
+    cc = ctx;
+    ctx->cache_sources = 1;
+    for (;;) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        serve_request(ctx, client);
+        close(client);
+    }
+    close(fd);
+    unlink(path);
+    sectorc_free(ctx);
+    return 1;
+}
+
+static int run_client(const char *path, int argc, char **argv) {
+    struct sockaddr_un addr;
+    int fd = unix_socket(path, &addr);
+    if (fd < 0) return 1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(path);
+        return 1;
+    }
+
+    /* The output file is written here, relative to the client */
+    const char *outname = "a.s";
+    for (int i = 0; i + 1 < argc; i++)
+        if (strcmp(argv[i], "-o") == 0) outname = argv[i + 1];
+
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) { perror("getcwd"); return 1; }
+    int ok = send_frame(fd, 'C', cwd, strlen(cwd)) == 0;
+    for (int i = 0; ok && i < argc; i++) ok = send_frame(fd, 'A', argv[i], strlen(argv[i])) == 0;
+    if (!ok || send_frame(fd, 'E', "", 0) < 0) { perror("send"); return 1; }
+
+    FILE *out = NULL;
+    int type, status = 1;
+    char *data;
+    size_t len;
+    while (recv_frame(fd, &type, &data, &len) == 0) {
+        if (type == 'O') {
+            if (!out && !(out = fopen(outname, "w"))) {
+                fprintf(stderr, "Cannot create: %s\n", outname);
+                free(data);
+                break;
+            }
+            fwrite(data, 1, len, out);
+        }
+        else if (type == 'D') fwrite(data, 1, len, stderr);
+        else if (type == 'X') { status = len ? (unsigned char)data[0] : 1; free(data); break; }
+        free(data);
+    }
+    if (out) fclose(out);
+    close(fd);
+    return status;
+}
+
+int main(int argc, char **argv) {
+    struct command cmd;
+
+    if (argc >= 3 && strcmp(argv[1], "--server") == 0) return run_server(argv[2]);
+    if (argc >= 3 && strcmp(argv[1], "--client") == 0)
+        return run_client(argv[2], argc - 3, argv + 3);
+
+    struct sectorc *ctx = sectorc_new();
+    if (!ctx) { fprintf(stderr, "out of memory\n"); return 1; }
+    cc = ctx;
+    if (parse_command(ctx, argc - 1, argv + 1, &cmd, stderr)) return 1;
+
+    FILE *out = NULL;
+    if (!cmd.bench && !cmd.cache_stats && !(out = fopen(cmd.outname, "w"))) {
+        fprintf(stderr, "Cannot create: %s\n", cmd.outname);
+        return 1;
+    }
+    int status = run_command(ctx, &cmd, stderr, write_output, out);
+    if (out) fclose(out);
+    return status;
+}
+
+#endif
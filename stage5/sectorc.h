@@ -0,0 +1,36 @@
+/*
+ * sectorc.h - Stage 5 compiler as a library
+ *
+ * Build cc.c with -DSECTORC_LIBRARY to leave out main(). Each context
+ * holds one compilation's state; different contexts may be used from
+ * different threads at the same time, a single context may not.
+ */
+
+#ifndef SECTORC_H
+#define SECTORC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct sectorc;
+
+/* Receives the generated assembly, possibly in several pieces */
+typedef void (*sectorc_sink)(const char *data, size_t len, void *user);
+
+struct sectorc *sectorc_new(void);
+void sectorc_free(struct sectorc *ctx);
+
+/* Apply a command-line option ("--whole-program", "-j4", ...); 0 if unknown */
+int sectorc_option(struct sectorc *ctx, const char *opt);
+
+/* Compile one translation unit from memory; 0 on success */
+int sectorc_compile(struct sectorc *ctx, const char *src, size_t len,
+                    sectorc_sink out, void *user);
+
+/* Where diagnostics go; NULL (the default) means stderr */
+void sectorc_set_diag(struct sectorc *ctx, FILE *diag);
+
+/* First error of the last failed compilation, or "" */
+const char *sectorc_error(struct sectorc *ctx);
+
+#endif
@@ -75,6 +75,8 @@ test_forth "RSHIFT" "2" "16 3 RSHIFT . BYE"
 echo ""
 echo "--- I/O ---"
 test_forth "EMIT" "A" "65 EMIT BYE"
+test_forth "FLUSH" "AB" "65 EMIT FLUSH 66 EMIT BYE"
+test_forth "output before error" "1Stackunderflow" "1 . DROP DROP"
 
 # Complex expressions
 echo ""
@@ -83,6 +85,53 @@ test_forth "complex 1" "25" "5 DUP * . BYE"
 test_forth "complex 2" "14" "2 3 + 2 * 4 + . BYE"
 test_forth "complex 3" "100" "10 10 * . BYE"
 
+# forth.fth is loaded by the ARM64 stage1/forth.s, not by this binary,
+# so check that every word it uses exists there or earlier in the file
+echo ""
+echo "--- forth.fth Words ---"
+ROOT="$(cd "$(dirname "$0")/../.." && pwd)"
+echo -n "Testing: forth.fth words resolve... "
+undefined=$(awk -v q="'" '
+    FNR == 1 { file++ }
+    file == 1 {
+        if ($0 ~ /^name_/) header = 1
+        else if (header && $0 ~ /\.byte/) {
+            s = $0; name = ""
+            while (match(s, q "(\\\\.|[^" q "])" q)) {
+                c = substr(s, RSTART + 1, RLENGTH - 2)
+                if (c ~ /^\\/) c = substr(c, 2)
+                name = name c
+                s = substr(s, RSTART + RLENGTH)
+            }
+            known[name] = 1
+            header = 0
+        }
+        next
+    }
+    {
+        for (i = 1; i <= NF; i++) {
+            t = $i
+            if (paren) { if (t ~ /\)$/) paren = 0; continue }
+            if (t == "\\") break
+            if (t == "(") { paren = 1; continue }
+            if (define) { known[t] = 1; define = 0; continue }
+            if (t ~ /^-?[0-9]+$/) continue
+            if (!(t in known)) print FNR ": " t
+            if (t == ":" && !compiling) { compiling = 1; define = 1 }
+            else if (t == ";") compiling = 0
+            else if (!compiling && (t == "CONSTANT" || t == "VARIABLE" ||
+                                    t == "VALUE" || t == "CREATE")) define = 1
+        }
+    }
+' "$ROOT/stage1/forth.s" "$ROOT/stage2/forth.fth")
+if [ -z "$undefined" ]; then
+    echo "PASS"
+    ((PASSED++))
+else
+    echo "FAIL (undefined: $(echo $undefined))"
+    ((FAILED++))
+fi
+
 echo ""
 echo "=== Results ==="
 echo "Passed: $PASSED"
@@ -11,7 +11,7 @@ test_forth() {
     local input="$3"
 
     echo -n "Testing: $name... "
-    local actual=$(echo "$input" | "$FORTH" 2>&1 | tr -d '\n')
+    local actual=$(echo "$input" | "$FORTH" $FORTH_ARGS 2>&1 | tr -d '\n')
 
     # Trim leading/trailing whitespace for comparison
     expected=$(echo "$expected" | xargs)
@@ -60,6 +60,108 @@ echo "--- Strings ---"
 test_forth "S\" TYPE" "Hello" 'S" Hello" TYPE BYE'
 test_forth ".\"" "Hello" '." Hello" BYE'
 
+# Dictionary lookup
+echo ""
+echo "--- Dictionary ---"
+test_forth "case-insensitive names" "5" ": foo 5 ; FOO . BYE"
+test_forth "redefinition shadows" "2" ": A 1 ; : A 2 ; A . BYE"
+test_forth "earlier callers keep old word" "1" ": A 1 ; : B A ; : A 2 ; B . BYE"
+test_forth "hidden during definition" "11" ": A 1 ; : A A 10 + ; A . BYE"
+test_forth "RECURSE" "3 2 1" ": CD DUP . 1 - DUP 0BRANCH [ 1 , ] RECURSE ; 3 CD DROP BYE"
+
+# Inner interpreter
+echo ""
+echo "--- Inner Interpreter ---"
+test_forth "EXECUTE" "7" ": A 7 ; ' A EXECUTE . BYE"
+test_forth "EXECUTE in definition" "7" ": A 7 ; : RUN EXECUTE ; ' A RUN . BYE"
+test_forth "deep calls" "0" ": CD 1 - DUP 0BRANCH [ 1 , ] RECURSE ; 500 CD . BYE"
+test_forth "return stack overflow" "return stack overflow" ": CD 1 - DUP 0BRANCH [ 1 , ] RECURSE ; 600 CD . BYE"
+test_forth "NULL cell" "1 null word" ": T 1 . [ ' MISSING , ] 2 . ; T BYE"
+
+# Superinstructions
+echo ""
+echo "--- Superinstructions ---"
+test_forth "LIT +" "6" ": F 5 + ; 1 F . BYE"
+test_forth "LIT -" "-4" ": F 5 - ; 1 F . BYE"
+test_forth "LIT =" "-1 0" ": F 5 = ; 5 F . 4 F . BYE"
+test_forth "OVER OVER" "2 1 2 1" ": F OVER OVER ; 1 2 F . . . . BYE"
+test_forth "SWAP DROP" "2" ": F SWAP DROP ; 1 2 F . BYE"
+test_forth "0= 0BRANCH" "7" ": F 0= 0BRANCH [ 3 , ] 7 . ; 0 F 1 F BYE"
+test_forth "branch into fused sequence" "7 8" ": G 0BRANCH [ 2 , ] 5 + ; 3 4 0 G . 3 1 G . BYE"
+test_forth "inline data skipped" "1" ": T BRANCH [ 2 , 7 , 8 , ] 1 . ; T BYE"
+
+# Counted loops
+echo ""
+echo "--- Counted Loops ---"
+test_forth "DO LOOP" "0 1 2 3 4" ": F 5 0 DO I . LOOP ; F BYE"
+test_forth "?DO empty" "7" ": F 0 0 ?DO 9 . LOOP 7 . ; F BYE"
+test_forth "nested J" "0 0 0 1 1 0 1 1" ": F 2 0 DO 2 0 DO J . I . LOOP LOOP ; F BYE"
+test_forth "+LOOP up" "0 3 6 9" ": F 10 0 DO I . 3 +LOOP ; F BYE"
+test_forth "+LOOP down" "10 7 4 1" ": F 0 10 DO I . -3 +LOOP ; F BYE"
+test_forth "+LOOP down to limit" "0 -1" ": F -1 0 DO I . -1 +LOOP ; F BYE"
+test_forth "LEAVE" "0 1 2 3 9" ": F 10 0 DO I DUP . 3 = 0BRANCH [ 3 , ] LEAVE LOOP 9 . ; F BYE"
+test_forth "UNLOOP EXIT" "0 1 2 0" ": F 10 0 DO I 3 = 0BRANCH [ 2 , ] UNLOOP EXIT I . LOOP ; F DEPTH . BYE"
+test_forth "I via EXECUTE" "0 1 2" ": F 3 0 DO DUP EXECUTE . LOOP DROP ; ' I F BYE"
+test_forth "DO without LOOP" "DO without LOOP" ": F 3 0 DO ; BYE"
+
+# Memory blocks
+echo ""
+echo "--- Memory Blocks ---"
+test_forth "CMOVE" "hello" 'S" hello" HERE SWAP CMOVE HERE 5 TYPE BYE'
+test_forth "CMOVE overlapping" "aaaaa" 'S" abcde" HERE SWAP MOVE HERE HERE 1 + 4 CMOVE HERE 5 TYPE BYE'
+test_forth "CMOVE>" "ababcd" 'S" abcdef" HERE SWAP MOVE HERE HERE 2 + 4 CMOVE> HERE 6 TYPE BYE'
+test_forth "MOVE" "aabcd" 'S" abcde" HERE SWAP MOVE HERE HERE 1 + 4 MOVE HERE 5 TYPE BYE'
+test_forth "FILL" "AAA" 'HERE 3 65 FILL HERE 3 TYPE BYE'
+test_forth "COMPARE" "-1 0 1 -1" 'S" abc" S" abd" COMPARE . S" abc" S" abc" COMPARE . S" abcd" S" abc" COMPARE . S" ab" S" abc" COMPARE . BYE'
+test_forth "SEARCH found" "-1 world" 'S" hello world" S" wor" SEARCH . TYPE BYE'
+test_forth "SEARCH missing" "0 hello" 'S" hello" S" xyz" SEARCH . TYPE BYE'
+test_forth "SEARCH repeated prefix" "-1 ab" 'S" aab" S" ab" SEARCH . TYPE BYE'
+
+# CONSTANT, VARIABLE, VALUE, CREATE ... DOES>
+echo ""
+echo "--- Data Words ---"
+test_forth "CONSTANT" "7 8" "7 CONSTANT SEVEN SEVEN . : T SEVEN 1 + ; T . BYE"
+test_forth "VARIABLE" "5 7" "VARIABLE V 5 V ! V @ . : BUMP V @ 1 + V ! ; BUMP BUMP V @ . BYE"
+test_forth "VALUE and TO" "10 20 30 30" "10 VALUE X X . 20 TO X X . : SETX TO X ; 30 SETX X . : GX X ; GX . BYE"
+test_forth "CREATE" "2 3" "CREATE TBL 1 , 2 , 3 , TBL 8 + @ . : T2 TBL 16 + @ ; T2 . BYE"
+test_forth "DOES>" "42 43" ": CONST CREATE , DOES> @ ; 42 CONST ANSWER ANSWER . : T ANSWER 1 + ; T . BYE"
+test_forth "DOES> array" "9" ": ARRAY CREATE CELLS ALLOT DOES> SWAP CELLS + ; 4 ARRAY A 9 2 A ! 2 A @ . BYE"
+test_forth "TO non-value" "TO needs a VALUE" "TO DUP BYE"
+test_forth "DOES> without CREATE" "DOES> without CREATE" ": X DOES> ; X BYE"
+
+# MARKER / FORGET
+echo ""
+echo "--- Forgetting ---"
+test_forth "FORGET unshadows" "1" ": A 1 ; : A 2 ; FORGET A A . BYE"
+test_forth "FORGET gives back space" "-1" "HERE : X 1 2 + ; : Y X ; FORGET X HERE = . BYE"
+test_forth "MARKER" "5 1" ': A 1 ; MARKER -M : A 5 ; A . -M A . BYE'
+test_forth "MARKER forgets itself" "-1" 'HERE MARKER -M : Q S" q" ; -M HERE = . -M BYE'
+test_forth "FORGET built-in" "cannot forget that" "FORGET DUP BYE"
+
+# Dictionary images
+echo ""
+echo "--- Images ---"
+IMAGE=$(mktemp)
+echo ': SQ DUP * ; : HI ." hi" ; : T 3 0 DO I SQ . LOOP ; SAVE-IMAGE '"$IMAGE"' BYE' | "$FORTH" >/dev/null 2>&1
+FORTH_ARGS="--image $IMAGE" test_forth "words from image" "49 hi 0 1 4" "7 SQ . HI SPACE T BYE"
+FORTH_ARGS="--image $IMAGE" test_forth "image extends" "64" ": CUBE DUP SQ * ; 4 CUBE . BYE"
+IMAGE2=$(mktemp)
+echo ': A 1 ; MARKER -M : A 5 ; SAVE-IMAGE '"$IMAGE2"' BYE' | "$FORTH" >/dev/null 2>&1
+FORTH_ARGS="--image $IMAGE2" test_forth "marker from image" "5 1 3" "A . -M A . : B 3 ; B . BYE"
+echo ': CONST CREATE , DOES> @ ; 6 CONST SIX 2 VALUE N VARIABLE V SAVE-IMAGE '"$IMAGE2"' BYE' | "$FORTH" >/dev/null 2>&1
+FORTH_ARGS="--image $IMAGE2" test_forth "data words from image" "6 3 4" "SIX . 3 TO N N . 4 V ! V @ . BYE"
+rm -f "$IMAGE2"
+printf '\377' | dd of="$IMAGE" bs=1 seek=200 conv=notrunc 2>/dev/null
+FORTH_ARGS="--image $IMAGE" test_forth "corrupt image" "image checksum mismatch" "BYE"
+rm -f "$IMAGE"
+
+# Buffered output
+echo ""
+echo "--- Output ---"
+test_forth "FLUSH" "AB" "65 EMIT FLUSH 66 EMIT BYE"
+test_forth "output at EOF" "7" "7 ."
+test_forth "output before error" "1 stack underflow" "1 . DROP DROP"
+
 # Number bases
 echo ""
 echo "--- Number Bases ---"
@@ -0,0 +1,36 @@
+// Test dead-code elimination: unreachable and constant-false code is dropped
+
+int early(int x) {
+    return x;
+    x = x + 1;
+    return 99;
+}
+
+int main(void) {
+    int r = 0;
+
+    if (0) {
+        r = 1;
+    }
+    if (1) {
+        r = r + 2;
+    } else {
+        r = 100;
+    }
+    while (0) {
+        r = 200;
+    }
+    for (int i = 0; i < 3; i = i + 1) {
+        r = r + 1;
+        continue;
+        r = 300;
+    }
+    while (1) {
+        break;
+        r = 400;
+    }
+
+    // 2 + 3 = 5
+    if (r == 5 && early(7) == 7) return 0;
+    return 1;
+}
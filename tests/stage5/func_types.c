@@ -0,0 +1,12 @@
+// Function types: a call has the type its declaration returns
+
+char *skip(char *s, int n);
+
+char *skip(char *s, int n) {
+    return s + n;
+}
+
+int main(void) {
+    char *p = skip("abcd", 1);
+    return skip(p, 2)[0] - 'd';
+}
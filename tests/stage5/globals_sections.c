@@ -0,0 +1,17 @@
+// Test section placement: zero globals in .zerofill, const data read-only
+
+int big[4096];
+const int limit;
+const char *msg = "hi";
+char *const fixed = "ab";
+
+int main(void) {
+    big[4095] = 7;
+    if (big[0] != 0) return 1;
+    if (big[4095] != 7) return 2;
+    if (limit != 0) return 3;
+    msg = "yo";
+    if (msg[0] != 'y') return 4;
+    if (fixed[1] != 'b') return 5;
+    return 0;
+}
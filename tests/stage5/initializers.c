@@ -0,0 +1,25 @@
+// Test static initializers: scalars, arrays, designators, strings, addresses
+
+enum { THREE = 3, FOUR };
+
+int answer = 40 + 2;
+int table[] = {1, 2, THREE * 4, [6] = FOUR};
+char word[] = "sector";
+char *greeting = "hello";
+int *answer_ptr = &answer;
+_Bool flag = 5;
+
+int main(void) {
+    int local[5] = {10, 20, 30, 40, 50};
+    char name[] = "bootstrap";
+
+    if (answer != 42) return 1;
+    if (table[2] != 12 || table[5] != 0 || table[6] != 4) return 2;
+    if (word[0] != 's' || word[6] != 0) return 3;
+    if (greeting[1] != 'e') return 4;
+    if (*answer_ptr != 42) return 5;
+    if (flag != 1) return 6;
+    if (local[0] + local[4] != 60) return 7;
+    if (name[4] != 't' || name[9] != 0) return 8;
+    return 0;
+}
@@ -0,0 +1,20 @@
+// Test the bulk lexer paths: long comments, identifiers and string
+// runs that cross 16-byte blocks, and escapes inside strings
+
+/* A block comment long enough to span several blocks, with a * star,
+   a / slash and ** doubled stars ** before the end */
+
+int a_rather_long_identifier_that_crosses_blocks = 40;
+
+int main(void) {
+    char *s = "plain text that runs past sixteen bytes\tand\\on";
+    char *h = "\x41z";
+    int n = 0;
+    // a line comment that is also longer than a single block ............
+    while (s[n]) n++;
+    if (n != 46) return 1;
+    if (s[39] != '\t' || s[43] != '\\' || s[44] != 'o') return 2;
+    if (h[0] != 'A' || h[1] != 'z' || h[2] != 0) return 3;
+    if (a_rather_long_identifier_that_crosses_blocks + 2 != 42) return 4;
+    return 0;
+}
@@ -15,8 +15,8 @@ run_test() {
 
     echo -n "Testing $name... "
 
-    # Compile with Stage 5 compiler
-    $CC "$source" -o /tmp/test.s 2>/dev/null
+    # Compile with Stage 5 compiler (several sources form one program)
+    $CC $source -o /tmp/test.s 2>/dev/null
     if [ $? -ne 0 ]; then
         echo "FAILED (compilation error)"
         FAILED=$((FAILED + 1))
@@ -44,6 +44,35 @@ run_test() {
     fi
 }
 
+# Compile only and check the assembly: each pattern is followed by the
+# number of lines that must match it
+check_asm() {
+    local name=$1
+    local source=$2
+    shift 2
+
+    echo -n "Checking $name... "
+
+    $CC $source -o /tmp/test.s 2>/dev/null
+    if [ $? -ne 0 ]; then
+        echo "FAILED (compilation error)"
+        FAILED=$((FAILED + 1))
+        return
+    fi
+
+    while [ $# -gt 0 ]; do
+        local count=$(grep -c -- "$1" /tmp/test.s)
+        if [ "$count" -ne "$2" ]; then
+            echo "FAILED ('$1': expected $2, got $count)"
+            FAILED=$((FAILED + 1))
+            return
+        fi
+        shift 2
+    done
+    echo "PASSED"
+    PASSED=$((PASSED + 1))
+}
+
 echo "=== Stage 5 C99 Compiler Tests ==="
 echo ""
 
@@ -52,8 +81,157 @@ run_test "C99 comments" "c99_comments.c" 0
 run_test "C99 _Bool type" "c99_bool.c" 0
 run_test "C99 for-loop declaration" "c99_for_decl.c" 0
 run_test "C99 inline functions" "c99_inline.c" 0
+run_test "dead code elimination" "dead_code.c" 0
+run_test "global sections" "globals_sections.c" 0
+run_test "static initializers" "initializers.c" 0
+run_test "string pooling" "string_pool.c" 0
+run_test "function types" "func_types.c" 0
+run_test "bulk lexer" "lexer.c" 0
+run_test "pipelined lexer" "--pipeline lexer.c" 0
+run_test "parallel unit optimization" "--peephole -j 4 wp_main.c wp_lib.c" 0
+run_test "whole-program mode" "wp_main.c wp_lib.c" 0
+run_test "per-file scope" "scope_a.c scope_b.c" 0
 run_test "arrays" "../stage3/arrays.c" 0
 
+# What the generated code must and must not contain
+echo ""
+check_asm "dead code removed" "dead_code.c" \
+    "#99$" 0 "#100$" 0 "#200$" 0 "#300$" 0 "#400$" 0 "^L[0-9]*:" 3
+check_asm "global sections" "globals_sections.c" \
+    "^\.zerofill __DATA,__bss,_big,16384," 1 "^\.const$" 1 \
+    "^\.section __DATA,__const$" 1 "^\.data$" 1
+check_asm "static initializers" "initializers.c" \
+    "\.long 42$" 1 "\.space 12$" 1 "\.quad _answer$" 1 "\.quad _str0$" 1 \
+    "^___tmpl[0-9]*:" 2
+check_asm "string pooling" "string_pool.c" \
+    "^_str[0-9]*:" 2 '\.asciz "pool' 1 '\.ascii "string "' 1
+check_asm "function types" "func_types.c" "ldrb w0" 1 "lsl x0, x0, #3" 0
+check_asm "whole-program mode" "wp_main.c wp_lib.c" \
+    "^_main:" 1 "^_lib_double:" 1 "_lib_unused" 0 "_unused_table" 0
+check_asm "per-file scope" "scope_a.c scope_b.c" \
+    "^_helper\.0:" 1 "^_helper\.1:" 1 "^_total\.0:" 1 "^_total\.1:" 1 \
+    "\.global _helper" 0 "\.global _total" 0
+echo ""
+
+# The unit workers must not change the output
+echo -n "Testing -j 1 against -j 8... "
+if $CC --peephole -j 1 lexer.c -o /tmp/test_j1.s 2>/dev/null &&
+   $CC --peephole -j 8 lexer.c -o /tmp/test_j8.s 2>/dev/null &&
+   cmp -s /tmp/test_j1.s /tmp/test_j8.s; then
+    echo "PASSED"
+    PASSED=$((PASSED + 1))
+else
+    echo "FAILED"
+    FAILED=$((FAILED + 1))
+fi
+rm -f /tmp/test_j1.s /tmp/test_j8.s
+
+# Compile cache: a repeat is a hit with the same output, --peephole is not
+echo -n "Testing compile cache... "
+CACHE=/tmp/sectorc_test_cache
+rm -rf $CACHE
+if $CC --cache-dir=$CACHE c99_bool.c -o /tmp/test_c1.s 2>/dev/null &&
+   $CC --cache-dir=$CACHE c99_bool.c -o /tmp/test_c2.s 2>/dev/null &&
+   $CC --cache-dir=$CACHE --peephole c99_bool.c -o /tmp/test_c3.s 2>/dev/null &&
+   cmp -s /tmp/test_c1.s /tmp/test_c2.s &&
+   $CC --cache-dir=$CACHE --cache-stats | grep -q "1 hits, 2 misses, 2 entries"; then
+    echo "PASSED"
+    PASSED=$((PASSED + 1))
+else
+    echo "FAILED"
+    FAILED=$((FAILED + 1))
+fi
+rm -rf $CACHE /tmp/test_c1.s /tmp/test_c2.s /tmp/test_c3.s
+
+# Library API: contexts on separate threads, errors reported, not fatal
+echo -n "Testing library API... "
+cat > /tmp/test_lib.c <<'END'
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sectorc.h"
+
+static const char good[] = "int twice(int x) { return x + x; }\n"
+                           "int main(void) { return twice(21); }\n";
+static const char bad[] = "int main( {\n";
+
+struct job { char text[4096]; size_t len; int status; };
+
+static void sink(const char *data, size_t len, void *user) {
+    struct job *j = user;
+    if (j->len + len < sizeof(j->text)) memcpy(j->text + j->len, data, len);
+    j->len += len;
+}
+
+static void *compile(void *arg) {
+    struct job *j = arg;
+    struct sectorc *ctx = sectorc_new();
+    for (int i = 0; i < 50 && !j->status; i++) {
+        j->len = 0;
+        j->status = sectorc_compile(ctx, good, sizeof(good) - 1, sink, j);
+    }
+    sectorc_free(ctx);
+    return NULL;
+}
+
+int main(void) {
+    static struct job jobs[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) pthread_create(&threads[i], NULL, compile, &jobs[i]);
+    for (int i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+    for (int i = 0; i < 4; i++)
+        if (jobs[i].status || jobs[i].len != jobs[0].len ||
+            memcmp(jobs[i].text, jobs[0].text, jobs[0].len) != 0) return 1;
+    if (!strstr(jobs[0].text, "bl _twice")) return 2;
+
+    static struct job j;
+    struct sectorc *ctx = sectorc_new();
+    FILE *diag = fopen("/dev/null", "w");
+    sectorc_set_diag(ctx, diag);
+    if (sectorc_option(ctx, "--no-such-option")) return 3;
+    if (sectorc_compile(ctx, bad, sizeof(bad) - 1, sink, &j) == 0) return 4;
+    if (!strstr(sectorc_error(ctx), "error")) return 5;
+    if (sectorc_compile(ctx, good, sizeof(good) - 1, sink, &j) != 0) return 6;
+    if (sectorc_error(ctx)[0]) return 7;
+    sectorc_free(ctx);
+    fclose(diag);
+    return 0;
+}
+END
+if $CLANG $CLANG_FLAGS -pthread -DSECTORC_LIBRARY -I../../stage5 -o /tmp/test_lib \
+       /tmp/test_lib.c ../../stage5/cc.c 2>/dev/null && /tmp/test_lib; then
+    echo "PASSED"
+    PASSED=$((PASSED + 1))
+else
+    echo "FAILED"
+    FAILED=$((FAILED + 1))
+fi
+rm -f /tmp/test_lib /tmp/test_lib.c
+
+# Compile server: bad requests get a diagnostic and the server keeps going
+echo -n "Testing compile server... "
+SOCK=/tmp/sectorc_test.sock
+rm -f $SOCK
+$CC --server $SOCK 2>/dev/null &
+SERVER=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do [ -S $SOCK ] && break; sleep 0.1; done
+printf 'int main( {\n' > /tmp/test_bad.c
+$CC --client $SOCK . -o /tmp/test.s 2>/tmp/test.err; dir_status=$?
+$CC --client $SOCK /tmp/test_bad.c -o /tmp/test.s 2>>/tmp/test.err; bad_status=$?
+$CC --client $SOCK c99_bool.c -o /tmp/test.s 2>/dev/null; good_status=$?
+kill $SERVER 2>/dev/null
+$CC c99_bool.c -o /tmp/test_direct.s 2>/dev/null
+if [ $dir_status -ne 0 ] && [ $bad_status -ne 0 ] && [ $good_status -eq 0 ] &&
+   grep -q "Cannot open: \." /tmp/test.err && grep -q "test_bad.c:[0-9]*: error" /tmp/test.err &&
+   cmp -s /tmp/test.s /tmp/test_direct.s; then
+    echo "PASSED"
+    PASSED=$((PASSED + 1))
+else
+    echo "FAILED"
+    FAILED=$((FAILED + 1))
+fi
+rm -f $SOCK /tmp/test_bad.c /tmp/test.err /tmp/test_direct.s
+
 echo ""
 echo "=== Results: $PASSED passed, $FAILED failed ==="
 
@@ -0,0 +1,17 @@
+// File scope: compiled together with scope_b.c, which reuses every name here
+
+#define count 7
+
+enum { LIMIT = 3 };
+
+struct pair { int a; int b; };
+
+static int total = 2;
+
+static int helper(void) {
+    return count + total;
+}
+
+int a_value(void) {
+    return helper();
+}
@@ -0,0 +1,19 @@
+// File scope: count, LIMIT, pair, total and helper all mean something new here
+
+int count;
+
+int LIMIT;
+
+struct pair { long a; long b; };
+
+static int total = 3;
+
+static int helper(void) {
+    return total;
+}
+
+int main(void) {
+    count = 30;
+    LIMIT = 2;
+    return a_value() + helper() + count + LIMIT - 44;
+}
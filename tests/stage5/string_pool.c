@@ -0,0 +1,14 @@
+// Test string literal pooling: identical literals share storage and
+// a literal that is a suffix of another points into it
+
+int main(void) {
+    char *a = "pool\n";
+    char *b = "pool\n";
+    char *c = "string pool\n";
+
+    if (a != b) return 1;
+    if (c + 7 != a) return 2;
+    if (a[0] != 'p' || a[4] != '\n' || a[5] != 0) return 3;
+    if (c[0] != 's') return 4;
+    return 0;
+}
@@ -0,0 +1,11 @@
+// Helpers for wp_main.c; only lib_double is reachable from main
+
+int unused_table[1024];
+
+int lib_unused(int x) {
+    return unused_table[x];
+}
+
+int lib_double(int x) {
+    return x + x;
+}
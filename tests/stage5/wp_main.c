@@ -0,0 +1,9 @@
+// Test whole-program mode: compiled together with wp_lib.c
+
+int counter;
+
+int main(void) {
+    counter = lib_double(21);
+    if (counter == 42) return 0;
+    return 1;
+}
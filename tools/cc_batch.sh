@@ -0,0 +1,27 @@
+#!/bin/bash
+# Compile several C files with stage3/cc.fth in one Forth process.
+# Each foo.c is written to foo.s. Needs stage0/stage0 and stage1.hex
+# from bootstrap.sh.
+
+if [ $# -eq 0 ]; then
+    echo "Usage: $0 <file.c>..."
+    exit 1
+fi
+
+set -e
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+
+# Files go in separated by ASCII FS; cc.fth ends each output with FS + newline
+OUT=$(mktemp)
+trap 'rm -f "$OUT"' EXIT
+(cat "$ROOT/stage1.hex"; printf "\x60"; cat "$ROOT/stage2/forth.fth" "$ROOT/stage3/cc.fth"
+ for f in "$@"; do cat "$f"; printf "\x1c"; done) | "$ROOT/stage0/stage0" > "$OUT"
+
+exec 3< "$OUT"
+for f in "$@"; do
+    if ! IFS= read -r -d $'\x1c' asm <&3; then
+        echo "$f: no output (compile error?)" >&2
+        exit 1
+    fi
+    printf '%s' "${asm#$'\n'}" > "${f%.c}.s"
+done